@@ -0,0 +1,35 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace bench
+{
+// Calls `fn` until at least `min_seconds` have passed and returns calls per second
+double rate(const std::function<void()> &fn, double min_seconds = 0.5);
+
+// Prints `name` with its throughput and keeps it for the JSON report
+void print_rate(const std::string &name, double mib_per_second);
+// Keeps a result in another unit, e.g. files per second, for the JSON report; printing is up to the caller
+void record(const std::string &name, double value, const char *unit);
+
+// Largest input the size-class suites generate, set with --max-size
+size_t max_size();
+
+// Game-file-like data: blocks of ini-style text lines alternating with little-endian record tables,
+// so it deflates to roughly what real files do; the same `seed` gives the same bytes
+std::vector<unsigned char> corpus(size_t size, uint32_t seed = 1);
+
+void run_blowfish();
+void run_crc32();
+void run_protocols();
+void run_rsa();
+void run_xor();
+void run_zlib();
+} // namespace bench
+
+#endif // BENCH_H
@@ -0,0 +1,63 @@
+#include "bench.h"
+#include "blowfish.h"
+#include "thread_pool.h"
+#include <blowfish/blowfish.h>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+constexpr size_t PAYLOAD_SIZE = 16 << 20;
+constexpr size_t SMALL_FILE_SIZE = 4096;
+const std::string KEY_211 = "31==-%&@!^+][;'.]94-";
+
+void report(const char *name, double calls)
+{
+    bench::print_rate(name, calls * PAYLOAD_SIZE / (1 << 20));
+}
+} // namespace
+
+void bench::run_blowfish()
+{
+    std::vector<unsigned char> input(PAYLOAD_SIZE, 0x5A);
+    std::vector<unsigned char> output(PAYLOAD_SIZE);
+
+    report("avinal, block at a time", bench::rate([&]()
+                                                  {
+        Blowfish bf(KEY_211 + '\0');
+        for (size_t i = 0; i + 8 <= input.size(); i += 8)
+        {
+            uint32_t l, r;
+            std::memcpy(&l, &input[i], 4);
+            std::memcpy(&r, &input[i + 4], 4);
+            bf.decrypt(l, r);
+            std::memcpy(&output[i], &l, 4);
+            std::memcpy(&output[i + 4], &r, 4);
+        } }));
+
+    auto key = blowfish::load_key(KEY_211);
+    thread_pool::set_max_threads(1);
+    report("blowfish::decrypt, 1 thread", bench::rate([&]()
+                                                      { blowfish::decrypt(std::span<const unsigned char>(input), std::span(output), *key); }));
+
+    thread_pool::set_max_threads(0);
+    report("blowfish::decrypt, all", bench::rate([&]()
+                                                 { blowfish::decrypt(std::span<const unsigned char>(input), std::span(output), *key); }));
+    report("blowfish::encrypt, all", bench::rate([&]()
+                                                 { blowfish::encrypt(std::span<const unsigned char>(input), std::span(output), *key); }));
+
+    std::vector<unsigned char> small(SMALL_FILE_SIZE, 0x5A), small_output;
+    double avinal_files = bench::rate([&]()
+                                      {
+        Blowfish bf(KEY_211 + '\0');
+        uint32_t l = small[0], r = small[1];
+        bf.decrypt(l, r);
+        small_output.assign(1, static_cast<unsigned char>(l ^ r)); });
+    double cached_files = bench::rate([&]()
+                                      { blowfish::decrypt(small, small_output, KEY_211); });
+    std::printf("%zu-byte files/s: key schedule per file %.0f (one block only), cached key %.0f\n",
+                SMALL_FILE_SIZE, avinal_files, cached_files);
+    bench::record("4 KiB files, key schedule per file", avinal_files, "files/s");
+    bench::record("4 KiB files, cached key", cached_files, "files/s");
+}
@@ -0,0 +1,38 @@
+#include "bench.h"
+#include "crc32.h"
+#include "zlib_utils.h"
+#include <cstdio>
+#include <miniz.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+constexpr size_t PAYLOAD_SIZE = 64 << 20;
+
+void report(const std::string &name, double calls)
+{
+    std::printf("%-28s %10.2f GB/s\n", name.c_str(), calls * PAYLOAD_SIZE / 1e9);
+    bench::record(name, calls * PAYLOAD_SIZE / 1e9, "GB/s");
+}
+} // namespace
+
+void bench::run_crc32()
+{
+    std::vector<unsigned char> input(PAYLOAD_SIZE);
+    for (size_t i = 0; i < input.size(); ++i)
+        input[i] = static_cast<unsigned char>(i * 131);
+
+    volatile uint32_t sink = 0;
+    report("mz_crc32", bench::rate([&]()
+                                   { sink = static_cast<uint32_t>(mz_crc32(MZ_CRC32_INIT, input.data(), input.size())); }));
+
+    report("slice-by-16", bench::rate([&]()
+                                      { sink = crc32::update_portable(0, input); }));
+
+    report(std::string("update, ") + crc32::kernel_name(), bench::rate([&]()
+                                                                       { sink = crc32::update(0, input); }));
+
+    report("zlib_utils::checksum", bench::rate([&]()
+                                               { sink = zlib_utils::checksum(input); }));
+}
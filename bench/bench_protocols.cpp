@@ -0,0 +1,87 @@
+#include "bench.h"
+#include "l2encdec.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace
+{
+constexpr size_t SIZE_CLASSES[] = {
+    1 << 10,
+    16 << 10,
+    256 << 10,
+    4 << 20,
+    64 << 20,
+    512 << 20,
+};
+
+// large inputs take seconds per call, so one timed call is enough
+constexpr double MIN_SECONDS = 0.2;
+// largest size class in the small-file comparison
+constexpr size_t SMALL_FILE_SIZE = 16 << 10;
+
+std::string size_name(size_t size)
+{
+    return size >= (1 << 20) ? std::to_string(size >> 20) + " MiB" : std::to_string(size >> 10) + " KiB";
+}
+} // namespace
+
+void bench::run_protocols()
+{
+    std::printf("%-8s %10s %14s %14s\n", "protocol", "size", "encode MiB/s", "decode MiB/s");
+    for (size_t size : SIZE_CLASSES)
+    {
+        if (size > bench::max_size())
+            break;
+
+        auto input = bench::corpus(size);
+        std::vector<unsigned char> encoded, decoded;
+        for (int protocol : l2encdec::SUPPORTED_PROTOCOLS)
+        {
+            l2encdec::Params params;
+            l2encdec::init_params(params, protocol, "bench.ini");
+
+            double encode = bench::rate([&]()
+                                        { l2encdec::encode(input, encoded, params); }, MIN_SECONDS);
+            double decode = bench::rate([&]()
+                                        { l2encdec::decode(encoded, decoded, params); }, MIN_SECONDS);
+            if (decoded != input)
+                std::printf("%d %s: decoded data differs\n", protocol, size_name(size).c_str());
+
+            double mib = static_cast<double>(size) / (1 << 20);
+            std::string name = std::to_string(protocol) + ", " + size_name(size);
+            bench::record("encode " + name, encode * mib, "MiB/s");
+            bench::record("decode " + name, decode * mib, "MiB/s");
+            std::printf("%-8d %10s %14.1f %14.1f\n", protocol, size_name(size).c_str(), encode * mib, decode * mib);
+        }
+    }
+
+    // setting up the keys and layout dominates small files, so compare doing it per call with a prepared Codec
+    std::printf("\n%-8s %10s %16s %16s\n", "protocol", "size", "params files/s", "codec files/s");
+    for (size_t size : SIZE_CLASSES)
+    {
+        if (size > SMALL_FILE_SIZE || size > bench::max_size())
+            break;
+
+        auto input = bench::corpus(size);
+        std::vector<unsigned char> encoded, decoded;
+        for (int protocol : l2encdec::SUPPORTED_PROTOCOLS)
+        {
+            l2encdec::Params params;
+            l2encdec::init_params(params, protocol, "bench.ini");
+            l2encdec::Codec codec(params);
+
+            double with_params = bench::rate([&]()
+                                             { l2encdec::encode(input, encoded, params);
+                                               l2encdec::decode(encoded, decoded, params); }, MIN_SECONDS);
+            double with_codec = bench::rate([&]()
+                                            { codec.encode(input, encoded);
+                                              codec.decode(encoded, decoded); }, MIN_SECONDS);
+
+            std::string name = std::to_string(protocol) + ", " + size_name(size);
+            bench::record("round trip with params " + name, with_params, "files/s");
+            bench::record("round trip with codec " + name, with_codec, "files/s");
+            std::printf("%-8d %10s %16.0f %16.0f\n", protocol, size_name(size).c_str(), with_params, with_codec);
+        }
+    }
+}
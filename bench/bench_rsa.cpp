@@ -0,0 +1,159 @@
+#include "bench.h"
+#include "l2encdec.h"
+#include "memory.h"
+#include "montgomery.h"
+#include "pipeline.h"
+#include "rsa.h"
+#include "zlib_utils.h"
+#include <cstdio>
+#include <mbedtls/bignum.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+constexpr size_t BLOCK_SIZE = 128;
+constexpr size_t PAYLOAD_SIZE = 1 << 20;
+constexpr size_t BATCH_FILES = 64;
+constexpr size_t BATCH_FILE_SIZE = 4096;
+
+struct Case
+{
+    const char *name;
+    int protocol;
+    bool legacy;
+};
+
+constexpr Case CASES[] = {
+    {"411 legacy", 411, true},
+    {"413 legacy", 413, true},
+    {"modern", 411, false},
+};
+
+void bench_exp_mod(const Case &c)
+{
+    l2encdec::Params params;
+    l2encdec::init_params(params, c.protocol, "", c.legacy);
+
+    mbedtls_mpi n, e, rr, x, y;
+    mbedtls_mpi_init(&n);
+    mbedtls_mpi_init(&e);
+    mbedtls_mpi_init(&rr);
+    mbedtls_mpi_init(&x);
+    mbedtls_mpi_init(&y);
+    mbedtls_mpi_read_string(&n, 16, params.rsa_modulus.c_str());
+    mbedtls_mpi_read_string(&e, 16, params.rsa_private_exponent.c_str());
+
+    unsigned char block[BLOCK_SIZE];
+    auto input = bench::corpus(BLOCK_SIZE);
+    mbedtls_mpi_read_binary(&x, input.data(), BLOCK_SIZE);
+
+    double mbedtls_rate = bench::rate([&]()
+                                      {
+        mbedtls_mpi_exp_mod(&y, &x, &e, &n, &rr);
+        mbedtls_mpi_write_binary(&y, block, BLOCK_SIZE); });
+
+    unsigned char modulus[BLOCK_SIZE];
+    mbedtls_mpi_write_binary(&n, modulus, BLOCK_SIZE);
+    montgomery::Context ctx;
+    montgomery::init(ctx, modulus, std::stoull(params.rsa_private_exponent, nullptr, 16));
+
+    double montgomery_rate = bench::rate([&]()
+                                         { montgomery::exp_mod(ctx, input.data(), block); });
+
+    std::printf("%-12s %14.0f %14.0f %8.2fx\n", c.name, mbedtls_rate, montgomery_rate, montgomery_rate / mbedtls_rate);
+    bench::record(std::string("exp_mod mbedtls, ") + c.name, mbedtls_rate, "blocks/s");
+    bench::record(std::string("exp_mod montgomery, ") + c.name, montgomery_rate, "blocks/s");
+
+    mbedtls_mpi_free(&n);
+    mbedtls_mpi_free(&e);
+    mbedtls_mpi_free(&rr);
+    mbedtls_mpi_free(&x);
+    mbedtls_mpi_free(&y);
+}
+
+void bench_encrypt_decrypt()
+{
+    l2encdec::Params params;
+    l2encdec::init_params(params, 413);
+
+    auto input = bench::corpus(PAYLOAD_SIZE);
+    std::vector<unsigned char> encrypted, decrypted;
+    double calls = bench::rate([&]()
+                               { rsa::encrypt(input, encrypted, params.rsa_modulus, params.rsa_public_exponent); });
+    bench::print_rate("rsa::encrypt, 1 MiB", calls * input.size() / (1 << 20));
+
+    calls = bench::rate([&]()
+                        { rsa::decrypt(encrypted, decrypted, params.rsa_modulus, params.rsa_private_exponent); });
+    bench::print_rate("rsa::decrypt, 1 MiB", calls * encrypted.size() / (1 << 20));
+}
+
+void bench_pipeline()
+{
+    l2encdec::Params params;
+    l2encdec::init_params(params, 413);
+    auto public_key = rsa::load_key(params.rsa_modulus, params.rsa_public_exponent);
+    auto private_key = rsa::load_key(params.rsa_modulus, params.rsa_private_exponent);
+
+    auto input = bench::corpus(PAYLOAD_SIZE);
+    std::vector<unsigned char> packed, blocks, output(input.size());
+
+    double sequential = bench::rate([&]()
+                                    {
+        zlib_utils::pack(input, packed);
+        rsa::encrypt(packed, blocks, *public_key); });
+    memory::Scratch pipelined_blocks(nullptr);
+    double pipelined = bench::rate([&]()
+                                   { pipeline::encode(input, zlib_utils::BEST_COMPRESSION, *public_key, pipelined_blocks); });
+    std::printf("encode %zu KiB: pack + encrypt %.1f MiB/s, pipeline %.1f MiB/s\n",
+                PAYLOAD_SIZE / 1024, sequential * PAYLOAD_SIZE / (1 << 20), pipelined * PAYLOAD_SIZE / (1 << 20));
+    bench::record("encode, pack + encrypt", sequential * PAYLOAD_SIZE / (1 << 20), "MiB/s");
+    bench::record("encode, pipeline", pipelined * PAYLOAD_SIZE / (1 << 20), "MiB/s");
+
+    std::vector<unsigned char> decrypted;
+    sequential = bench::rate([&]()
+                             {
+        rsa::decrypt(blocks, decrypted, *private_key);
+        zlib_utils::unpack(decrypted, output); });
+    pipelined = bench::rate([&]()
+                            { pipeline::decode(blocks, *private_key, output); });
+    std::printf("decode %zu KiB: decrypt + unpack %.1f MiB/s, pipeline %.1f MiB/s\n",
+                PAYLOAD_SIZE / 1024, sequential * PAYLOAD_SIZE / (1 << 20), pipelined * PAYLOAD_SIZE / (1 << 20));
+    bench::record("decode, decrypt + unpack", sequential * PAYLOAD_SIZE / (1 << 20), "MiB/s");
+    bench::record("decode, pipeline", pipelined * PAYLOAD_SIZE / (1 << 20), "MiB/s");
+}
+
+void bench_encode_batch()
+{
+    l2encdec::Params params;
+    l2encdec::init_params(params, 413);
+
+    std::vector<std::vector<unsigned char>> inputs(BATCH_FILES, bench::corpus(BATCH_FILE_SIZE));
+    std::vector<std::vector<unsigned char>> outputs;
+
+    double per_file = bench::rate([&]()
+                                  {
+        std::vector<unsigned char> output;
+        for (const auto &input : inputs)
+            l2encdec::encode(input, output, params); });
+
+    double batched = bench::rate([&]()
+                                 { l2encdec::encode_batch(inputs, outputs, params); });
+
+    std::printf("encode %zu x %zu KiB: per-file %.1f batches/s, encode_batch %.1f batches/s\n",
+                BATCH_FILES, BATCH_FILE_SIZE / 1024, per_file, batched);
+    bench::record("64 x 4 KiB, encode per file", per_file, "batches/s");
+    bench::record("64 x 4 KiB, encode_batch", batched, "batches/s");
+}
+} // namespace
+
+void bench::run_rsa()
+{
+    std::printf("%-12s %14s %14s %9s\n", "key", "mbedtls blk/s", "montgomery", "speedup");
+    for (const auto &c : CASES)
+        bench_exp_mod(c);
+
+    bench_encrypt_decrypt();
+    bench_pipeline();
+    bench_encode_batch();
+}
@@ -0,0 +1,36 @@
+#include "bench.h"
+#include "xor_utils.h"
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+constexpr size_t PAYLOAD_SIZE = 64 << 20;
+
+void report(const char *name, double calls)
+{
+    bench::print_rate(name, calls * PAYLOAD_SIZE / (1 << 20));
+}
+} // namespace
+
+void bench::run_xor()
+{
+    std::vector<unsigned char> input(PAYLOAD_SIZE, 0x5A);
+    std::vector<unsigned char> output(PAYLOAD_SIZE);
+
+    report("byte loop, single key", bench::rate([&]()
+                                                {
+        for (size_t i = 0; i < input.size(); ++i)
+            output[i] = input[i] ^ 0xAC; }));
+
+    report("apply, single key", bench::rate([&]()
+                                            { xor_utils::apply(std::span<const unsigned char>(input), std::span(output), 0xAC); }));
+
+    report("byte loop, get_key_by_index", bench::rate([&]()
+                                                      {
+        for (size_t i = 0; i < input.size(); ++i)
+            output[i] = input[i] ^ static_cast<unsigned char>(xor_utils::get_key_by_index(0xE6 + static_cast<int>(i))); }));
+
+    report("apply_position", bench::rate([&]()
+                                         { xor_utils::apply_position(input, output, 0xE6); }));
+}
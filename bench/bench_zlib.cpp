@@ -0,0 +1,118 @@
+#include "bench.h"
+#include "l2encdec.h"
+#include "thread_pool.h"
+#include "zlib_utils.h"
+#include <cstdio>
+#include <cstdint>
+#include <miniz.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+constexpr size_t PAYLOAD_SIZE = 16 << 20;
+constexpr size_t INFLATE_CHUNK_SIZE = 1024 * 16;
+
+void report(const char *name, double calls)
+{
+    bench::print_rate(name, calls * PAYLOAD_SIZE / (1 << 20));
+}
+
+// the previous unpack, growing the output by INFLATE_CHUNK_SIZE per call
+int chunked_unpack(const std::vector<unsigned char> &input, std::vector<unsigned char> &output)
+{
+    tinfl_decompressor decomp;
+    tinfl_init(&decomp);
+    output.clear();
+    size_t in_pos = 4;
+    size_t out_pos = 0;
+
+    while (in_pos < input.size())
+    {
+        output.resize(out_pos + INFLATE_CHUNK_SIZE);
+        size_t in_bytes = input.size() - in_pos;
+        size_t out_bytes = output.size() - out_pos;
+        tinfl_status status = tinfl_decompress(&decomp,
+                                               input.data() + in_pos, &in_bytes,
+                                               output.data(), output.data() + out_pos, &out_bytes,
+                                               TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF | TINFL_FLAG_PARSE_ZLIB_HEADER);
+        in_pos += in_bytes;
+        out_pos += out_bytes;
+
+        if (status == TINFL_STATUS_DONE)
+        {
+            output.resize(out_pos);
+            return 0;
+        }
+        else if (status < 0)
+        {
+            return -1;
+        }
+    }
+
+    return -1;
+}
+
+// rows of little-endian records with slowly changing fields, like the game's .dat tables
+std::vector<unsigned char> make_table(size_t size)
+{
+    std::vector<unsigned char> data;
+    data.reserve(size);
+    for (uint32_t id = 0; data.size() < size; ++id)
+    {
+        uint32_t fields[] = {id, id / 7, 0, (id * 2654435761u) >> 20, 100, id % 3};
+        auto bytes = reinterpret_cast<const unsigned char *>(fields);
+        data.insert(data.end(), bytes, bytes + sizeof(fields));
+    }
+    data.resize(size);
+    return data;
+}
+
+void report_levels(const char *name, const std::vector<unsigned char> &input)
+{
+    std::printf("%s, %zu MiB\n", name, input.size() >> 20);
+    std::printf("  %-5s %10s %8s %12s\n", "level", "size", "ratio", "MiB/s");
+    std::vector<unsigned char> packed;
+    for (int level = 0; level <= zlib_utils::BEST_COMPRESSION; ++level)
+    {
+        double calls = bench::rate([&]()
+                                   { zlib_utils::pack(input, packed, level); });
+        std::printf("  %-5d %10zu %7.1f%% %12.1f\n", level, packed.size(),
+                    100.0 * packed.size() / input.size(), calls * input.size() / (1 << 20));
+        bench::record(std::string(name) + ", level " + std::to_string(level), calls * input.size() / (1 << 20), "MiB/s");
+    }
+}
+} // namespace
+
+void bench::run_zlib()
+{
+    report_levels("pack, corpus", bench::corpus(4 << 20));
+    report_levels("pack, table", make_table(4 << 20));
+
+    auto input = bench::corpus(PAYLOAD_SIZE);
+
+    std::vector<unsigned char> packed_serial;
+    thread_pool::set_max_threads(1);
+    report("pack, 1 thread", bench::rate([&]()
+                                         { zlib_utils::pack(input, packed_serial); }));
+    thread_pool::set_max_threads(0);
+    report("pack, all threads", bench::rate([&]()
+                                            { zlib_utils::pack(input, packed_serial); }));
+
+    std::vector<unsigned char> packed, output;
+    zlib_utils::pack(input, packed);
+
+    report("chunked unpack", bench::rate([&]()
+                                         { chunked_unpack(packed, output); }));
+
+    report("zlib_utils::unpack", bench::rate([&]()
+                                             { zlib_utils::unpack(packed, output); }));
+
+    l2encdec::Params params;
+    l2encdec::init_params(params, 413);
+    std::vector<unsigned char> encoded, decoded;
+    l2encdec::encode(input, encoded, params);
+
+    report("l2encdec::decode, 413", bench::rate([&]()
+                                                { l2encdec::decode(encoded, decoded, params); }));
+}
@@ -0,0 +1,51 @@
+#include "bench.h"
+#include <algorithm>
+#include <string>
+
+namespace
+{
+// text and tables alternate at this granularity, well below the deflate window
+constexpr size_t BLOCK_SIZE = 16 * 1024;
+
+void append_text(std::vector<unsigned char> &data, size_t size, uint32_t &state)
+{
+    size_t end = data.size() + size;
+    while (data.size() < end)
+    {
+        state = state * 1103515245 + 12345;
+        std::string line = "item_" + std::to_string((state >> 8) % 5000) + "\tname=[" +
+                           std::to_string((state >> 4) % 97) + "]\tvalue=" + std::to_string(state % 1000) + "\r\n";
+        data.insert(data.end(), line.begin(), line.end());
+    }
+    data.resize(end);
+}
+
+void append_table(std::vector<unsigned char> &data, size_t size, uint32_t &id)
+{
+    size_t end = data.size() + size;
+    for (; data.size() < end; ++id)
+    {
+        uint32_t fields[] = {id, id / 7, 0, (id * 2654435761u) >> 20, 100, id % 3};
+        auto bytes = reinterpret_cast<const unsigned char *>(fields);
+        data.insert(data.end(), bytes, bytes + sizeof(fields));
+    }
+    data.resize(end);
+}
+} // namespace
+
+std::vector<unsigned char> bench::corpus(size_t size, uint32_t seed)
+{
+    std::vector<unsigned char> data;
+    data.reserve(size);
+    uint32_t state = seed;
+    uint32_t id = seed;
+    for (bool text = true; data.size() < size; text = !text)
+    {
+        size_t block = std::min(BLOCK_SIZE, size - data.size());
+        if (text)
+            append_text(data, block, state);
+        else
+            append_table(data, block, id);
+    }
+    return data;
+}
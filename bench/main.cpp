@@ -0,0 +1,167 @@
+#include "bench.h"
+#include "crc32.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifndef L2ENCDEC_VERSION
+#define L2ENCDEC_VERSION "unknown"
+#endif
+
+namespace
+{
+struct Suite
+{
+    const char *name;
+    void (*run)();
+};
+
+constexpr Suite SUITES[] = {
+    {"blowfish", bench::run_blowfish},
+    {"crc32", bench::run_crc32},
+    {"protocols", bench::run_protocols},
+    {"rsa", bench::run_rsa},
+    {"xor", bench::run_xor},
+    {"zlib", bench::run_zlib},
+};
+
+struct Result
+{
+    std::string suite;
+    std::string name;
+    double value;
+    const char *unit;
+};
+
+std::vector<Result> results;
+const char *current_suite = "";
+size_t max_corpus_size = 512 << 20;
+
+// a whole number of MiB that still fits in size_t as bytes
+bool parse_mebibytes(const char *text, size_t &bytes)
+{
+    size_t mebibytes;
+    const char *end = text + std::strlen(text);
+    auto [ptr, ec] = std::from_chars(text, end, mebibytes);
+    if (ec != std::errc() || ptr != end || mebibytes > (SIZE_MAX >> 20))
+        return false;
+    bytes = mebibytes << 20;
+    return true;
+}
+
+std::string json_string(const std::string &text)
+{
+    std::string quoted = "\"";
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            quoted += '\\';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+bool write_json(const std::string &path)
+{
+    std::ofstream file(path, std::ios::trunc);
+    file << "{\n"
+         << "  \"version\": " << json_string(L2ENCDEC_VERSION) << ",\n"
+         << "  \"threads\": " << thread_pool::concurrency() << ",\n"
+         << "  \"crc32_kernel\": " << json_string(crc32::kernel_name()) << ",\n"
+         << "  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i)
+        file << (i == 0 ? "\n" : ",\n")
+             << "    {\"suite\": " << json_string(results[i].suite) << ", \"name\": " << json_string(results[i].name)
+             << ", \"value\": " << results[i].value << ", \"unit\": " << json_string(results[i].unit) << "}";
+    file << "\n  ]\n}\n";
+    return static_cast<bool>(file.flush());
+}
+
+void print_usage(const char *name)
+{
+    std::cout << "Usage: " << name << " [--json <file>] [--max-size <MiB>] [suite...]\n"
+              << "Suites:";
+    for (const auto &suite : SUITES)
+        std::cout << " " << suite.name;
+    std::cout << "\n";
+}
+} // namespace
+
+double bench::rate(const std::function<void()> &fn, double min_seconds)
+{
+    using clock = std::chrono::steady_clock;
+
+    fn();
+    size_t calls = 0;
+    auto start = clock::now();
+    std::chrono::duration<double> elapsed{};
+    do
+    {
+        fn();
+        ++calls;
+        elapsed = clock::now() - start;
+    } while (elapsed.count() < min_seconds);
+
+    return calls / elapsed.count();
+}
+
+void bench::print_rate(const std::string &name, double mib_per_second)
+{
+    std::printf("%-28s %10.1f MiB/s\n", name.c_str(), mib_per_second);
+    record(name, mib_per_second, "MiB/s");
+}
+
+void bench::record(const std::string &name, double value, const char *unit)
+{
+    results.push_back({current_suite, name, value, unit});
+}
+
+size_t bench::max_size()
+{
+    return max_corpus_size;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string json_path;
+    std::vector<std::string> selected;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+            json_path = argv[++i];
+        else if (std::strcmp(argv[i], "--max-size") == 0 && i + 1 < argc && parse_mebibytes(argv[i + 1], max_corpus_size))
+            ++i;
+        else if (argv[i][0] == '-')
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+        else
+            selected.push_back(argv[i]);
+    }
+
+    for (const auto &suite : SUITES)
+    {
+        if (!selected.empty() && std::find(selected.begin(), selected.end(), suite.name) == selected.end())
+            continue;
+
+        std::cout << "== " << suite.name << " ==" << std::endl;
+        current_suite = suite.name;
+        suite.run();
+    }
+
+    if (!json_path.empty() && !write_json(json_path))
+    {
+        std::cerr << "Failed to write " << json_path << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -1,10 +1,24 @@
+#include "manifest.h"
+#include "mapped_file.h"
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <l2encdec.h>
-#include <map>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #ifdef _WIN32
@@ -13,20 +27,30 @@
 #include <unistd.h>
 #endif
 
-std::map<l2encdec::EncodeResult, const char *> ENCODE_ERRORS = {
+// the lookup tables below are constant-initialized, so starting the tool builds none of them
+template <typename Key, typename Value, size_t N>
+constexpr const Value *lookup(const std::pair<Key, Value> (&table)[N], const std::type_identity_t<Key> &key)
+{
+    for (const auto &[k, value] : table)
+        if (k == key)
+            return &value;
+    return nullptr;
+}
+
+constexpr std::pair<l2encdec::EncodeResult, const char *> ENCODE_ERRORS[] = {
     {l2encdec::EncodeResult::INVALID_TYPE, "Invalid protocol"},
     {l2encdec::EncodeResult::COMPRESSION_FAILED, "Failed to compress file"},
     {l2encdec::EncodeResult::ENCRYPTION_FAILED, "Failed to encrypt file"}};
 
-std::map<l2encdec::DecodeResult, const char *> DECODE_ERRORS = {
+constexpr std::pair<l2encdec::DecodeResult, const char *> DECODE_ERRORS[] = {
     {l2encdec::DecodeResult::INVALID_TYPE, "Invalid protocol"},
     {l2encdec::DecodeResult::DECOMPRESSION_FAILED, "Failed to decompress file"},
     {l2encdec::DecodeResult::DECRYPTION_FAILED, "Failed to decrypt file"}};
 
-std::map<l2encdec::ChecksumResult, const char *> CHECKSUM_ERRORS = {
+constexpr std::pair<l2encdec::ChecksumResult, const char *> CHECKSUM_ERRORS[] = {
     {l2encdec::ChecksumResult::MISMATCH, "Checksum mismatch"}};
 
-std::map<std::string, l2encdec::Type> ENCDEC_TYPES = {
+constexpr std::pair<std::string_view, l2encdec::Type> ENCDEC_TYPES[] = {
     {"blowfish", l2encdec::Type::BLOWFISH},
     {"rsa", l2encdec::Type::RSA},
     {"xor", l2encdec::Type::XOR},
@@ -39,42 +63,196 @@ enum class Command
     DECODE
 };
 
-std::map<std::string, Command> COMMANDS = {
+constexpr std::pair<std::string_view, Command> COMMANDS[] = {
     {"encode", Command::ENCODE},
     {"decode", Command::DECODE}};
 
-std::map<Command, std::string> PREFIXES = {
+constexpr std::pair<Command, const char *> PREFIXES[] = {
     {Command::ENCODE, "enc"},
     {Command::DECODE, "dec"}};
 
-const size_t DEFAULT_HEADER_SIZE = 28;
-const size_t TAIL_HEX_SIZE = 40;
+template <typename Result, size_t N>
+const char *error_message(const std::pair<Result, const char *> (&messages)[N], Result result)
+{
+    auto message = lookup(messages, result);
+    return message ? *message : "Unexpected error";
+}
 
-int read(const std::string &filename, std::vector<unsigned char> &data)
+std::string prefix(Command command)
 {
-    std::ifstream file(filename, std::ios::binary);
-    if (!file)
-        return 1;
+    return *lookup(PREFIXES, command);
+}
 
-    data.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+// command line settings applied to every input file
+struct Options
+{
+    Command command;
+    int protocol; // 0 reads it from each file
+    bool skip_tail;
+    bool verify;
+    bool use_legacy_decrypt_rsa;
+    l2encdec::Type algorithm;
+    std::string header;
+    std::string tail;
+    std::string modulus;
+    std::string exponent;
+    std::string blowfish_key;
+    std::string filename;
+    const int *xor_key;
+    const int *xor_start_position;
+    const int *compression_level;
+    std::pmr::memory_resource *memory_resource = nullptr; // scratch buffers of the calling worker
+};
 
-    return 0;
-}
+struct FileJob
+{
+    std::filesystem::path input;
+    std::string output; // empty picks the default name next to the input
+};
 
-int write(const std::string &filename, const std::vector<unsigned char> &data)
+struct FileReport
+{
+    const char *error = nullptr;
+    bool skipped = false;
+    bool unchanged = false; // matches the manifest, not processed again
+    size_t input_size = 0;
+};
+
+constexpr size_t DEFAULT_HEADER_SIZE = 28;
+constexpr size_t TAIL_HEX_SIZE = 40;
+
+// input that cannot be mapped is streamed through l2encdec::Encoder/Decoder in pieces of this size
+constexpr size_t READ_CHUNK_SIZE = 1024 * 1024;
+
+int write(const std::string &filename, std::span<const std::byte> data)
 {
     std::ofstream file(filename, std::ios::binary);
     if (!file)
         return 1;
 
-    file.write(reinterpret_cast<const char *>(data.data()), data.size());
+    file.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
     if (file.bad())
         return 1;
 
     return 0;
 }
 
-int read_protocol_from_input_data(std::vector<unsigned char> &data)
+int read_chunk(std::ifstream &file, std::vector<unsigned char> &buffer)
+{
+    buffer.resize(READ_CHUNK_SIZE);
+    file.read(reinterpret_cast<char *>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+    buffer.resize(static_cast<size_t>(file.gcount()));
+
+    return file.bad() ? 1 : 0;
+}
+
+// feeds the rest of `file` to `codec`, starting with the chunk already in `buffer`
+template <typename Codec>
+auto feed_file(Codec &codec, std::ifstream &file, std::vector<unsigned char> &buffer)
+{
+    while (!buffer.empty())
+    {
+        if (auto status = codec.feed(std::as_bytes(std::span(buffer))); status != decltype(status)::SUCCESS)
+            return status;
+        if (read_chunk(file, buffer) != 0)
+            break;
+    }
+
+    return codec.finish();
+}
+
+// runs the span API from the mapped input straight into a mapped output of the exact size
+const char *process_mapped(Command command,
+                           const l2encdec::Params &params,
+                           bool verify,
+                           std::span<const std::byte> input,
+                           const std::string &output_filename)
+{
+    size_t size = 0;
+    if (command == Command::ENCODE)
+        size = l2encdec::encoded_size_bound(input.size(), params);
+    else if (auto status = l2encdec::decoded_size(input, size, params); status != l2encdec::DecodeResult::SUCCESS)
+        return error_message(DECODE_ERRORS, status);
+
+    // outputs that cannot be mapped are written with a single call instead
+    MappedFile mapped_output = MappedFile::create(output_filename, size);
+    std::vector<std::byte> buffer;
+    if (!mapped_output.is_open())
+        buffer.resize(size);
+    std::span<std::byte> output = mapped_output.is_open() ? mapped_output.data() : std::span(buffer);
+
+    size_t written = 0;
+    if (command == Command::ENCODE)
+    {
+        if (auto status = l2encdec::encode(input, output, written, params); status != l2encdec::EncodeResult::SUCCESS)
+            return error_message(ENCODE_ERRORS, status);
+    }
+    else
+    {
+        // the checksum is computed in the same pass as decoding, so a mismatch is known only afterwards
+        auto checksum = l2encdec::ChecksumResult::SUCCESS;
+        auto status = verify ? l2encdec::decode(input, output, written, checksum, params)
+                             : l2encdec::decode(input, output, written, params);
+        if (status != l2encdec::DecodeResult::SUCCESS)
+            return error_message(DECODE_ERRORS, status);
+        if (checksum != l2encdec::ChecksumResult::SUCCESS)
+            return error_message(CHECKSUM_ERRORS, checksum);
+    }
+
+    bool saved = mapped_output.is_open() ? mapped_output.close(written) : write(output_filename, output.first(written)) == 0;
+    return saved ? nullptr : "Failed to save output file";
+}
+
+// feeds the input to l2encdec::Encoder/Decoder chunk by chunk, starting with `first_chunk`
+const char *process_streamed(Command command,
+                             const l2encdec::Params &params,
+                             bool verify,
+                             std::ifstream &input,
+                             std::vector<unsigned char> &first_chunk,
+                             size_t input_size,
+                             const std::string &output_filename)
+{
+    std::ofstream output(output_filename, std::ios::binary);
+    if (!output)
+        return "Failed to save output file";
+
+    l2encdec::Writer writer = [&output](std::span<const std::byte> data)
+    { output.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size())); };
+
+    const char *error = nullptr;
+    switch (command)
+    {
+    case Command::ENCODE:
+    {
+        l2encdec::Encoder encoder(params, writer, input_size);
+        if (auto status = feed_file(encoder, input, first_chunk);
+            status != l2encdec::EncodeResult::SUCCESS)
+            error = error_message(ENCODE_ERRORS, status);
+        break;
+    }
+    case Command::DECODE:
+    {
+        l2encdec::Decoder decoder(params, writer);
+        if (auto status = feed_file(decoder, input, first_chunk);
+            status != l2encdec::DecodeResult::SUCCESS)
+            error = error_message(DECODE_ERRORS, status);
+        else if (auto checksum = decoder.verify_checksum();
+                 verify && checksum != l2encdec::ChecksumResult::SUCCESS)
+            error = error_message(CHECKSUM_ERRORS, checksum);
+        break;
+    }
+    }
+
+    output.close();
+    if (!error && input.bad())
+        error = "Failed to read input file";
+    if (!error && output.fail())
+        error = "Failed to save output file";
+
+    return error;
+}
+
+int read_protocol_from_input_data(std::span<const unsigned char> data)
 {
     if (data.size() < DEFAULT_HEADER_SIZE)
         return 0;
@@ -113,18 +291,331 @@ int read_protocol_from_input_file_name(const std::string &input_file_name)
     }
 }
 
+// protocol given on the command line, or read from the header when decoding and from the name when encoding
+int detect_protocol(const Options &o, std::span<const unsigned char> head, const std::string &input_file_name)
+{
+    if (o.protocol != 0)
+        return o.protocol;
+
+    return o.command == Command::DECODE
+               ? read_protocol_from_input_data(head)
+               : read_protocol_from_input_file_name(input_file_name);
+}
+
+// `false` if `protocol` is set but not supported; the command line overrides are applied either way
+bool make_params(const Options &o, int protocol, const std::string &input_file_name, l2encdec::Params &params)
+{
+    params = {};
+    bool supported = protocol == 0 || l2encdec::init_params(params, protocol, input_file_name, o.use_legacy_decrypt_rsa);
+
+    params.skip_tail = o.skip_tail;
+    params.filename = o.filename == "" ? input_file_name : o.filename;
+
+    if (o.header != "")
+        params.header = o.header;
+    if (o.tail != "")
+        params.tail = o.tail;
+    if (o.algorithm != l2encdec::Type::NONE)
+        params.type = o.algorithm;
+    if (o.modulus != "")
+        params.rsa_modulus = o.modulus;
+    if (o.exponent != "")
+    {
+        params.rsa_private_exponent = o.exponent;
+        params.rsa_public_exponent = o.exponent;
+    }
+    if (o.blowfish_key != "")
+        params.blowfish_key = o.blowfish_key;
+    if (o.xor_key != nullptr)
+        params.xor_key = *o.xor_key;
+    if (o.xor_start_position != nullptr)
+        params.xor_start_position = *o.xor_start_position;
+    if (o.compression_level != nullptr)
+        params.compression_level = *o.compression_level;
+    params.memory_resource = o.memory_resource;
+
+    return supported;
+}
+
+// every setting that changes the output of `params`, so a manifest entry goes stale when any of them does
+uint64_t params_fingerprint(Command command, const l2encdec::Params &p)
+{
+    std::ostringstream fields;
+    fields << static_cast<int>(command) << '\n' << static_cast<int>(p.type) << '\n' << p.protocol << '\n' << p.header << '\n' << p.tail << '\n'
+           << p.skip_tail << p.skip_header << '\n' << p.filename << '\n' << p.xor_key << '\n' << p.xor_start_position << '\n'
+           << p.blowfish_key << '\n' << p.rsa_modulus << '\n' << p.rsa_public_exponent << '\n' << p.rsa_private_exponent << '\n'
+           << p.compression_level;
+    return hash_string(fields.str());
+}
+
+// encodes or decodes one file; in `batch` mode files without a known protocol are skipped and nothing is printed.
+// With a `manifest`, files whose content, settings and output are unchanged since it was written are not processed.
+FileReport process_file(const Options &o, const std::filesystem::path &input_path, std::string output_filename, bool batch,
+                        Manifest *manifest = nullptr)
+{
+    FileReport report;
+    std::string input_file = input_path.string();
+    std::string input_file_name = input_path.filename().string();
+    std::string input_file_dir = input_path.parent_path().string();
+
+    // pipes and files too large for the address space are read in chunks instead
+    MappedFile mapped_input = MappedFile::open(input_file);
+    std::ifstream input;
+    std::vector<unsigned char> input_data;
+    if (!mapped_input.is_open())
+    {
+        input.open(input_file, std::ios::binary);
+        if (!input || read_chunk(input, input_data) != 0)
+        {
+            report.error = "Failed to read input file";
+            return report;
+        }
+    }
+
+    auto input_head = mapped_input.is_open()
+                          ? std::span<const unsigned char>(reinterpret_cast<const unsigned char *>(mapped_input.data().data()), mapped_input.data().size())
+                          : std::span<const unsigned char>(input_data);
+    int protocol = detect_protocol(o, input_head, input_file_name);
+    if (batch && protocol == 0 && o.algorithm == l2encdec::Type::NONE)
+    {
+        report.skipped = true;
+        return report;
+    }
+
+    l2encdec::Params params;
+    if (!make_params(o, protocol, input_file_name, params) && !batch)
+        std::cerr << "Warning: unsupported protocol" << std::endl;
+
+    if (!batch)
+        std::cout << "Command: " << (o.command == Command::ENCODE ? "encode" : "decode") << std::endl
+                  << "Protocol: " << protocol << std::endl;
+
+    if (output_filename == "")
+    {
+        std::string new_output_file_name = o.command == Command::ENCODE
+                                               ? prefix(o.command) + "-" + input_file_name
+                                               : prefix(o.command) + "-" + std::to_string(protocol) + "-" + input_file_name;
+        output_filename = input_file_dir.empty()
+                              ? new_output_file_name
+                              : input_file_dir + "/" + new_output_file_name;
+    }
+
+    // the input is still being read while the output is written
+    std::error_code ec;
+    if (std::filesystem::equivalent(input_path, output_filename, ec))
+    {
+        report.error = "Output file must differ from input file";
+        return report;
+    }
+
+    // size and mtime settle most files without reading them; a touched file is hashed before it is redone
+    std::string manifest_key;
+    ManifestEntry entry{};
+    bool hashed = false;
+    if (manifest && mapped_input.is_open())
+    {
+        manifest_key = std::filesystem::absolute(input_path, ec).lexically_normal().string();
+        entry.size = mapped_input.data().size();
+        entry.mtime = static_cast<int64_t>(std::filesystem::last_write_time(input_path, ec).time_since_epoch().count());
+        entry.protocol = protocol;
+        entry.fingerprint = params_fingerprint(o.command, params);
+        entry.output = std::filesystem::absolute(output_filename, ec).lexically_normal().string();
+
+        auto previous = manifest->find(manifest_key);
+        if (previous && previous->size == entry.size && previous->fingerprint == entry.fingerprint &&
+            previous->output == entry.output && std::filesystem::exists(entry.output, ec))
+        {
+            if (previous->mtime == entry.mtime)
+            {
+                report.unchanged = true;
+                return report;
+            }
+
+            entry.hash = hash_bytes(mapped_input.data());
+            hashed = true;
+            if (previous->hash == entry.hash)
+            {
+                manifest->set(manifest_key, entry);
+                report.unchanged = true;
+                return report;
+            }
+        }
+    }
+
+    auto output_dir = std::filesystem::path(output_filename).parent_path();
+    if (!output_dir.empty())
+        std::filesystem::create_directories(output_dir, ec);
+
+    // RSA only streams its output when the size is known up front, which it is not for a pipe
+    auto file_size = std::filesystem::file_size(input_path, ec);
+    report.input_size = ec ? 0 : static_cast<size_t>(file_size);
+    size_t input_size = ec ? l2encdec::Encoder::UNKNOWN_SIZE : report.input_size;
+
+    bool verify = o.verify && !o.skip_tail;
+    report.error = mapped_input.is_open()
+                       ? process_mapped(o.command, params, verify, mapped_input.data(), output_filename)
+                       : process_streamed(o.command, params, verify, input, input_data, input_size, output_filename);
+    if (report.error)
+    {
+        std::filesystem::remove(output_filename, ec);
+        if (!manifest_key.empty())
+            manifest->erase(manifest_key);
+        return report;
+    }
+
+    if (!manifest_key.empty())
+    {
+        if (!hashed)
+            entry.hash = hash_bytes(mapped_input.data());
+        manifest->set(manifest_key, entry);
+    }
+
+    if (!batch)
+        std::cout << "Saved to: " << output_filename << std::endl;
+    return report;
+}
+
+// pairs every input file with its output; directories are walked recursively and mirrored under `output_root`,
+// which is the output file itself when the only input is a file
+std::vector<FileJob> collect_jobs(const Options &o, const std::vector<std::filesystem::path> &inputs, const std::string &output_root)
+{
+    std::vector<FileJob> jobs;
+    std::error_code ec;
+
+    for (const auto &input : inputs)
+    {
+        if (!std::filesystem::is_directory(input, ec))
+        {
+            if (output_root == "" || inputs.size() == 1)
+                jobs.push_back({input, output_root});
+            else
+                jobs.push_back({input, (std::filesystem::path(output_root) / input.filename()).string()});
+            continue;
+        }
+
+        auto dir = std::filesystem::absolute(input, ec).lexically_normal();
+        if (!dir.has_filename())
+            dir = dir.parent_path();
+
+        auto root = output_root == ""
+                        ? dir.parent_path() / (prefix(o.command) + "-" + dir.filename().string())
+                        : std::filesystem::absolute(output_root, ec).lexically_normal();
+
+        for (auto it = std::filesystem::recursive_directory_iterator(dir, ec); it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+        {
+            // an output tree inside the input directory is not input
+            auto from_root = it->path().lexically_relative(root);
+            if (!from_root.empty() && *from_root.begin() != "..")
+                continue;
+
+            if (it->is_regular_file(ec))
+                jobs.push_back({it->path(), (root / it->path().lexically_relative(dir)).string()});
+        }
+    }
+
+    return jobs;
+}
+
+// the first output that two jobs would write at once, or null
+const FileJob *find_shared_output(const std::vector<FileJob> &jobs)
+{
+    std::unordered_map<std::string, const FileJob *> seen;
+    std::error_code ec;
+    for (const auto &job : jobs)
+    {
+        // an empty output is named after the input, so the same input twice collides
+        auto key = job.output == "" ? "input:" + std::filesystem::absolute(job.input, ec).lexically_normal().string()
+                                    : std::filesystem::absolute(job.output, ec).lexically_normal().string();
+        if (!seen.emplace(key, &job).second)
+            return &job;
+    }
+    return nullptr;
+}
+
+// runs `jobs` on `threads` workers and prints failures as they happen, then a summary.
+// An existing manifest at `manifest_filename` skips unchanged files and is updated afterwards.
+int process_batch(const Options &o, const std::vector<FileJob> &jobs, size_t threads, const std::string &manifest_filename)
+{
+    std::optional<Manifest> manifest;
+    if (manifest_filename != "")
+        manifest.emplace(Manifest::load(manifest_filename));
+
+    std::atomic<size_t> next_job{0};
+    std::atomic<size_t> saved{0};
+    std::atomic<size_t> failed{0};
+    std::atomic<size_t> skipped{0};
+    std::atomic<size_t> unchanged{0};
+    std::atomic<size_t> bytes_read{0};
+    std::mutex print_mutex;
+
+    auto start = std::chrono::steady_clock::now();
+    auto worker = [&]()
+    {
+        // each worker reuses its scratch buffers from one file to the next; larger ones come straight from huge pages
+        std::pmr::unsynchronized_pool_resource pool(l2encdec::huge_page_resource());
+        Options options = o;
+        options.memory_resource = &pool;
+
+        for (size_t i = next_job.fetch_add(1); i < jobs.size(); i = next_job.fetch_add(1))
+        {
+            FileReport report = process_file(options, jobs[i].input, jobs[i].output, true, manifest ? &*manifest : nullptr);
+            if (report.skipped || report.unchanged)
+            {
+                ++(report.skipped ? skipped : unchanged);
+                continue;
+            }
+
+            bytes_read += report.input_size;
+            if (!report.error)
+            {
+                ++saved;
+                continue;
+            }
+
+            ++failed;
+            std::lock_guard<std::mutex> lock(print_mutex);
+            std::cerr << jobs[i].input.string() << ": " << report.error << std::endl;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < std::min(threads, jobs.size()); ++i)
+        workers.emplace_back(worker);
+    worker();
+    for (auto &w : workers)
+        w.join();
+
+    if (manifest && !manifest->save(manifest_filename))
+    {
+        std::cerr << "Failed to write manifest: " << manifest_filename << std::endl;
+        ++failed;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double mib = static_cast<double>(bytes_read.load()) / (1024 * 1024);
+    std::cout << "Command: " << (o.command == Command::ENCODE ? "encode" : "decode") << std::endl
+              << "Files: " << saved << " saved, " << unchanged << " unchanged, " << failed << " failed, " << skipped << " skipped (unknown protocol)" << std::endl
+              << std::fixed << std::setprecision(2)
+              << "Read " << mib << " MiB in " << seconds << " s (" << (seconds > 0 ? mib / seconds : 0) << " MiB/s)" << std::endl;
+
+    return failed == 0 ? 0 : 1;
+}
+
 void print_usage(const char *name)
 {
     std::cout << "Usage:\n"
-              << "  " << name << " [-c <command>] [-p <protocol>] [-o <output_file>] [-t] <input_file>\n\n"
+              << "  " << name << " [-c <command>] [-p <protocol>] [-o <output_file>] [-t] <input_file>...\n\n"
               << "Options:\n"
               << "  -h                    print help\n"
               << "  -c <command>          options: encode, decode; default: decode\n"
               << "  -p <protocol>         used for default params, options: 111, 120, 121, 211-212, 411-414\n"
-              << "  -o <output_file>      path to output file\n"
-              << "  -v                    verify checksum before decoding\n"
+              << "  -o <output_file>      path to output file; output directory when processing several files or a directory\n"
+              << "  -v                    verify checksum while decoding, no output is kept on mismatch\n"
               << "  -t                    do not add tail/read file without tail (e.g. for Exteel files)\n"
               << "  -l                    use legacy RSA credentials for decryption; only for protocols 411-414\n"
+              << "  -u <manifest_file>    only process files changed since the manifest was written, then update it\n"
+              << "  -j <threads>          maximum worker threads, also the number of files processed at once; default: all cores\n"
+              << "  -z <level>            compression level for `rsa` encoding, 0-9; default: 9\n"
               << "  -a <algorithm>        possible options: blowfish, rsa, xor, xor_position, xor_filename\n"
               << "  -m <modulus_hex>      custom modulus for `rsa`\n"
               << "  -e/-d <exponent_hex>  custom public or private exponent for `rsa`\n"
@@ -134,10 +625,13 @@ void print_usage(const char *name)
               << "  -s <start_index_hex>  custom start index for `xor_position` - protocol 120\n"
               << "  -w <header>           custom wide char header; default: Lineage2Ver<protocol>\n"
               << "  -T <tail_hex>         custom tail for encoding, e.g. 000000000000000000000000deadbeef00000000; contains checksum by default\n"
-              << "  <input_file>          path to input file\n\n"
+              << "  <input_file>...       paths to input files or directories; directories are processed recursively into\n"
+              << "                        a mirrored tree, by default next to them named <enc|dec>-<directory>\n\n"
               << "Example:\n"
               << "  " << name << " -c decode filename.ini\n"
               << "  " << name << " -c encode -p 413 -o enc-filename.ini dec-filename.ini\n"
+              << "  " << name << " -c decode -o decoded system\n"
+              << "  " << name << " -c encode -p 413 -u manifest.txt -o system dec-system\n"
               << "  " << name << " -c decode -a rsa -m 75b4d6...e2039 -d 1d -o dec-filename.ini -w Lineage2Ver413 filename.ini\n\n"
               << "Source code: " << "https://github.com/ritsuwastaken/open-l2encdec"
               << "\n";
@@ -147,6 +641,7 @@ int main(int argc, char *argv[])
 {
     Command command = Command::DECODE;
     std::string output_filename = "";
+    std::string manifest_filename = "";
     int protocol = 0;
     bool skip_tail = false;
     bool verify = false;
@@ -160,6 +655,8 @@ int main(int argc, char *argv[])
     std::string filename = "";
     int *xor_key = nullptr;
     int *xor_start_position = nullptr;
+    int *compression_level = nullptr;
+    size_t max_threads = 0;
 
     if (argc == 1)
     {
@@ -172,13 +669,13 @@ int main(int argc, char *argv[])
     if (has_single_option)
     {
         std::filesystem::path input_path(argv[optind]);
-        bool has_decode_prefix = input_path.filename().string().starts_with(PREFIXES[Command::DECODE] + "-");
+        bool has_decode_prefix = input_path.filename().string().starts_with(prefix(Command::DECODE) + "-");
         if (has_decode_prefix)
             command = Command::ENCODE;
     }
 
     int opt;
-    while ((opt = getopt(argc, argv, "hc:p:o:tla:w:e:d:m:b:x:s:vf:T:")) != -1)
+    while ((opt = getopt(argc, argv, "hc:p:o:tla:w:e:d:m:b:x:s:vf:T:j:z:u:")) != -1)
     {
         switch (opt)
         {
@@ -186,13 +683,13 @@ int main(int argc, char *argv[])
             print_usage(argv[0]);
             return 0;
         case 'c':
-            if (!optarg || !COMMANDS.contains(optarg))
+            if (!optarg || !lookup(COMMANDS, optarg))
             {
                 print_usage(argv[0]);
                 return 1;
             }
 
-            command = COMMANDS.at(optarg);
+            command = *lookup(COMMANDS, optarg);
             break;
         case 'p':
             if (!optarg)
@@ -221,6 +718,15 @@ int main(int argc, char *argv[])
             }
             output_filename = optarg;
             break;
+        case 'u':
+            if (!optarg)
+            {
+                std::cerr << "Manifest file option requires a value" << std::endl;
+                print_usage(argv[0]);
+                return 1;
+            }
+            manifest_filename = optarg;
+            break;
         case 't':
             skip_tail = true;
             break;
@@ -228,13 +734,13 @@ int main(int argc, char *argv[])
             use_legacy_decrypt_rsa = true;
             break;
         case 'a':
-            if (!optarg || !ENCDEC_TYPES.contains(optarg))
+            if (!optarg || !lookup(ENCDEC_TYPES, optarg))
             {
                 std::cerr << "Invalid algorithm" << std::endl;
                 print_usage(argv[0]);
                 return 1;
             }
-            algorithm = ENCDEC_TYPES.at(optarg);
+            algorithm = *lookup(ENCDEC_TYPES, optarg);
             break;
         case 'w':
             if (!optarg)
@@ -333,6 +839,46 @@ int main(int argc, char *argv[])
                 return 1;
             }
             break;
+        case 'j':
+            if (!optarg)
+            {
+                std::cerr << "Threads option requires a value" << std::endl;
+                print_usage(argv[0]);
+                return 1;
+            }
+            try
+            {
+                max_threads = std::stoul(optarg);
+                l2encdec::set_max_threads(max_threads);
+            }
+            catch (const std::exception &)
+            {
+                std::cerr << "Invalid threads value: " << optarg << std::endl;
+                return 1;
+            }
+            break;
+        case 'z':
+            if (!optarg)
+            {
+                std::cerr << "Compression level option requires a value" << std::endl;
+                print_usage(argv[0]);
+                return 1;
+            }
+            try
+            {
+                compression_level = new int(std::stoi(optarg));
+            }
+            catch (const std::exception &)
+            {
+                std::cerr << "Invalid compression level value: " << optarg << std::endl;
+                return 1;
+            }
+            if (*compression_level < 0 || *compression_level > 9)
+            {
+                std::cerr << "Compression level must be between 0 and 9" << std::endl;
+                return 1;
+            }
+            break;
         case '?':
             print_usage(argv[0]);
             return 1;
@@ -345,100 +891,31 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    std::filesystem::path input_path(argv[optind]);
-    std::string input_file = input_path.string();
-    std::string input_file_name = input_path.filename().string();
-    std::string input_file_dir = input_path.parent_path().string();
-
-    std::vector<unsigned char> input_data;
-    std::vector<unsigned char> output_data;
-
-    if (read(input_file, input_data) != 0)
-    {
-        std::cerr << "Failed to read input file: " << input_file << std::endl;
-        return 1;
-    }
-
-    protocol = protocol == 0
-                   ? (command == Command::DECODE
-                          ? read_protocol_from_input_data(input_data)
-                          : read_protocol_from_input_file_name(input_file_name))
-                   : protocol;
-
-    l2encdec::Params params{};
-    if (protocol != 0 && !l2encdec::init_params(params, protocol, input_file_name, use_legacy_decrypt_rsa))
-        std::cerr << "Warning: unsupported protocol" << std::endl;
+    Options options{command, protocol, skip_tail, verify, use_legacy_decrypt_rsa, algorithm, header, tail, modulus,
+                    exponent, blowfish_key, filename, xor_key, xor_start_position, compression_level};
 
-    params.skip_tail = skip_tail;
-    params.filename = filename == "" ? input_file_name : filename;
-
-    if (header != "")
-        params.header = header;
-    if (tail != "")
-        params.tail = tail;
-    if (algorithm != l2encdec::Type::NONE)
-        params.type = algorithm;
-    if (modulus != "")
-        params.rsa_modulus = modulus;
-    if (exponent != "")
+    std::vector<std::filesystem::path> inputs(argv + optind, argv + argc);
+    std::error_code ec;
+    if (inputs.size() == 1 && !std::filesystem::is_directory(inputs[0], ec) && manifest_filename == "")
     {
-        params.rsa_private_exponent = exponent;
-        params.rsa_public_exponent = exponent;
-    }
-    if (blowfish_key != "")
-        params.blowfish_key = blowfish_key;
-    if (xor_key != nullptr)
-        params.xor_key = *xor_key;
-    if (xor_start_position != nullptr)
-        params.xor_start_position = *xor_start_position;
-
-    std::cout << "Command: " << (command == Command::ENCODE ? "encode" : "decode") << std::endl
-              << "Protocol: " << protocol << std::endl;
-
-    switch (command)
-    {
-    case Command::ENCODE:
-        if (auto status = l2encdec::encode(input_data, output_data, params);
-            status != l2encdec::EncodeResult::SUCCESS)
-        {
-            std::cerr << ENCODE_ERRORS.at(status) << std::endl;
-            return 1;
-        }
-        break;
-    case Command::DECODE:
-        if (verify && !skip_tail)
-        {
-            if (auto status = l2encdec::verify_checksum(input_data);
-                status != l2encdec::ChecksumResult::SUCCESS)
-            {
-                std::cerr << CHECKSUM_ERRORS.at(status) << std::endl;
-                return 1;
-            }
-        }
-        if (auto status = l2encdec::decode(input_data, output_data, params);
-            status != l2encdec::DecodeResult::SUCCESS)
+        FileReport report = process_file(options, inputs[0], output_filename, false);
+        if (report.error)
         {
-            std::cerr << DECODE_ERRORS.at(status) << std::endl;
+            std::cerr << report.error << ": " << inputs[0].string() << std::endl;
             return 1;
         }
+        return 0;
     }
 
-    if (output_filename == "")
-    {
-        std::string new_output_file_name = command == Command::ENCODE
-                                               ? PREFIXES[command] + "-" + input_file_name
-                                               : PREFIXES[command] + "-" + std::to_string(protocol) + "-" + input_file_name;
-        output_filename = input_file_dir.empty()
-                              ? new_output_file_name
-                              : input_file_dir + "/" + new_output_file_name;
-    }
-
-    if (write(output_filename, output_data) != 0)
+    std::vector<FileJob> jobs = collect_jobs(options, inputs, output_filename);
+    if (const FileJob *job = find_shared_output(jobs))
     {
-        std::cerr << "Failed to save output file" << std::endl;
+        if (job->output == "")
+            std::cerr << "Input given more than once: " << job->input.string() << std::endl;
+        else
+            std::cerr << "More than one input would be saved to: " << job->output << std::endl;
         return 1;
     }
-
-    std::cout << "Saved to: " << output_filename << std::endl;
-    return 0;
+    size_t threads = max_threads != 0 ? max_threads : std::max(std::thread::hardware_concurrency(), 1u);
+    return process_batch(options, jobs, threads, manifest_filename);
 }
@@ -0,0 +1,162 @@
+#include "manifest.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string_view>
+
+namespace
+{
+constexpr std::string_view MANIFEST_VERSION = "l2encdec-manifest 3";
+constexpr uint64_t HASH_OFFSET = 0xcbf29ce484222325ULL;
+constexpr uint64_t HASH_PRIME = 0x100000001b3ULL;
+constexpr uint64_t MIX_MULTIPLIER = 0xd6e8feb86659fd93ULL;
+
+// multiply-xorshift finalizer: every input bit reaches every output bit
+uint64_t mix(uint64_t hash)
+{
+    hash ^= hash >> 32;
+    hash *= MIX_MULTIPLIER;
+    hash ^= hash >> 32;
+    hash *= MIX_MULTIPLIER;
+    return hash ^ (hash >> 32);
+}
+
+// paths may hold the field and line separators; tab, newline and backslash are written as \t, \n and \\ escapes
+std::string escape(std::string_view path)
+{
+    std::string escaped;
+    escaped.reserve(path.size());
+    for (char c : path)
+    {
+        if (c == '\t')
+            escaped += "\\t";
+        else if (c == '\n')
+            escaped += "\\n";
+        else if (c == '\\')
+            escaped += "\\\\";
+        else
+            escaped += c;
+    }
+    return escaped;
+}
+
+bool unescape(std::string_view escaped, std::string &path)
+{
+    path.clear();
+    for (size_t i = 0; i < escaped.size(); ++i)
+    {
+        if (escaped[i] != '\\')
+        {
+            path += escaped[i];
+            continue;
+        }
+        if (++i == escaped.size())
+            return false;
+        if (escaped[i] == 't')
+            path += '\t';
+        else if (escaped[i] == 'n')
+            path += '\n';
+        else if (escaped[i] == '\\')
+            path += '\\';
+        else
+            return false;
+    }
+    return true;
+}
+} // namespace
+
+Manifest::Manifest(Manifest &&other) noexcept
+    : entries_(std::move(other.entries_))
+{
+}
+
+Manifest Manifest::load(const std::string &path)
+{
+    Manifest manifest;
+    std::ifstream file(path);
+    std::string line;
+    if (!std::getline(file, line) || line != MANIFEST_VERSION)
+        return manifest;
+
+    // input \t size \t mtime \t hash \t protocol \t fingerprint \t output
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        std::string escaped_input, escaped_output, input;
+        ManifestEntry entry;
+        if (!std::getline(fields, escaped_input, '\t') ||
+            !(fields >> entry.size >> entry.mtime >> std::hex >> entry.hash >> std::dec >> entry.protocol >> std::hex >> entry.fingerprint) ||
+            fields.get() != '\t' || !std::getline(fields, escaped_output) ||
+            !unescape(escaped_input, input) || !unescape(escaped_output, entry.output))
+            continue;
+        manifest.entries_[input] = entry;
+    }
+
+    return manifest;
+}
+
+bool Manifest::save(const std::string &path) const
+{
+    // written aside and renamed so an interrupted run keeps the previous manifest
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::trunc);
+        file << MANIFEST_VERSION << '\n';
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto &[input, entry] : entries_)
+            file << escape(input) << '\t' << entry.size << '\t' << entry.mtime << '\t' << std::hex << entry.hash << std::dec << '\t'
+                 << entry.protocol << '\t' << std::hex << entry.fingerprint << std::dec << '\t' << escape(entry.output) << '\n';
+
+        if (!file.flush())
+            return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(temp_path, path, ec);
+    return !ec;
+}
+
+std::optional<ManifestEntry> Manifest::find(const std::string &input) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(input);
+    if (it == entries_.end())
+        return std::nullopt;
+    return it->second;
+}
+
+void Manifest::set(const std::string &input, const ManifestEntry &entry)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_[input] = entry;
+}
+
+void Manifest::erase(const std::string &input)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.erase(input);
+}
+
+// 8-byte words, each mixed in fully so hashing stays well ahead of the codecs; FNV-1a for the remaining bytes
+uint64_t hash_bytes(std::span<const std::byte> data, uint64_t seed)
+{
+    uint64_t hash = HASH_OFFSET ^ seed;
+    size_t pos = 0;
+    for (; pos + sizeof(uint64_t) <= data.size(); pos += sizeof(uint64_t))
+    {
+        uint64_t word;
+        std::memcpy(&word, data.data() + pos, sizeof(word));
+        hash = mix(hash ^ word);
+    }
+    for (; pos < data.size(); ++pos)
+        hash = (hash ^ static_cast<uint64_t>(data[pos])) * HASH_PRIME;
+
+    return mix(hash ^ data.size());
+}
+
+uint64_t hash_string(std::string_view text, uint64_t seed)
+{
+    return hash_bytes(std::as_bytes(std::span(text.data(), text.size())), seed);
+}
@@ -0,0 +1,48 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+// what an input looked like when its output was last written
+struct ManifestEntry
+{
+    uint64_t size;
+    int64_t mtime;
+    uint64_t hash; // hash_bytes of the content
+    int protocol;
+    uint64_t fingerprint; // hash of the command and every parameter that affects the output
+    std::string output;
+};
+
+// inputs already processed, keyed by absolute path; safe to use from several threads
+class Manifest
+{
+public:
+    // a missing or unreadable file gives an empty manifest
+    static Manifest load(const std::string &path);
+    bool save(const std::string &path) const;
+
+    Manifest() = default;
+    Manifest(Manifest &&other) noexcept;
+
+    std::optional<ManifestEntry> find(const std::string &input) const;
+    void set(const std::string &input, const ManifestEntry &entry);
+    void erase(const std::string &input);
+
+private:
+    std::map<std::string, ManifestEntry> entries_;
+    mutable std::mutex mutex_;
+};
+
+// 64-bit content hash to detect changes, not tampering
+uint64_t hash_bytes(std::span<const std::byte> data, uint64_t seed = 0);
+uint64_t hash_string(std::string_view text, uint64_t seed = 0);
+
+#endif // MANIFEST_H
@@ -0,0 +1,219 @@
+#include "mapped_file.h"
+#include <cstdint>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+{
+    *this = std::move(other);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept
+{
+    if (this != &other)
+    {
+        unmap();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        is_open_ = std::exchange(other.is_open_, false);
+        writable_ = std::exchange(other.writable_, false);
+#ifdef _WIN32
+        file_ = std::exchange(other.file_, nullptr);
+        mapping_ = std::exchange(other.mapping_, nullptr);
+#else
+        fd_ = std::exchange(other.fd_, -1);
+#endif
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile()
+{
+    unmap();
+}
+
+#ifdef _WIN32
+MappedFile MappedFile::open(const std::string &path)
+{
+    MappedFile mapped;
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return mapped;
+    mapped.file_ = file;
+
+    LARGE_INTEGER size;
+    if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &size) ||
+        static_cast<unsigned long long>(size.QuadPart) > SIZE_MAX)
+        return {};
+
+    mapped.size_ = static_cast<size_t>(size.QuadPart);
+    if (mapped.size_ != 0)
+    {
+        mapped.mapping_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapped.mapping_)
+            return {};
+        mapped.data_ = MapViewOfFile(mapped.mapping_, FILE_MAP_READ, 0, 0, 0);
+        if (!mapped.data_)
+            return {};
+    }
+
+    mapped.is_open_ = true;
+    return mapped;
+}
+
+MappedFile MappedFile::create(const std::string &path, size_t size)
+{
+    MappedFile mapped;
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return mapped;
+    mapped.file_ = file;
+    mapped.writable_ = true;
+
+    mapped.size_ = size;
+    if (size != 0)
+    {
+        // mapping past the end grows the file to `size`
+        unsigned long long wide_size = size;
+        mapped.mapping_ = CreateFileMappingA(file, nullptr, PAGE_READWRITE,
+                                             static_cast<DWORD>(wide_size >> 32), static_cast<DWORD>(wide_size), nullptr);
+        if (!mapped.mapping_)
+            return {};
+        mapped.data_ = MapViewOfFile(mapped.mapping_, FILE_MAP_WRITE, 0, 0, 0);
+        if (!mapped.data_)
+            return {};
+    }
+
+    mapped.is_open_ = true;
+    return mapped;
+}
+
+bool MappedFile::close(size_t size)
+{
+    if (!is_open_ || !writable_)
+        return false;
+
+    bool flushed = !data_ || FlushViewOfFile(data_, 0);
+    if (data_)
+        UnmapViewOfFile(data_);
+    if (mapping_)
+        CloseHandle(mapping_);
+    data_ = nullptr;
+    mapping_ = nullptr;
+
+    LARGE_INTEGER end;
+    end.QuadPart = static_cast<LONGLONG>(size);
+    bool truncated = SetFilePointerEx(file_, end, nullptr, FILE_BEGIN) && SetEndOfFile(file_);
+    CloseHandle(file_);
+    file_ = nullptr;
+    is_open_ = false;
+
+    return flushed && truncated;
+}
+
+void MappedFile::unmap()
+{
+    if (data_)
+        UnmapViewOfFile(data_);
+    if (mapping_)
+        CloseHandle(mapping_);
+    if (file_)
+        CloseHandle(file_);
+    data_ = nullptr;
+    mapping_ = nullptr;
+    file_ = nullptr;
+    is_open_ = false;
+}
+#else
+MappedFile MappedFile::open(const std::string &path)
+{
+    MappedFile mapped;
+    mapped.fd_ = ::open(path.c_str(), O_RDONLY);
+    if (mapped.fd_ < 0)
+        return mapped;
+
+    struct stat st;
+    if (fstat(mapped.fd_, &st) != 0 || !S_ISREG(st.st_mode) ||
+        static_cast<unsigned long long>(st.st_size) > SIZE_MAX)
+        return {};
+
+    mapped.size_ = static_cast<size_t>(st.st_size);
+    if (mapped.size_ != 0)
+    {
+        void *data = mmap(nullptr, mapped.size_, PROT_READ, MAP_PRIVATE, mapped.fd_, 0);
+        if (data == MAP_FAILED)
+            return {};
+        mapped.data_ = data;
+        // the codecs read front to back, so let the kernel read ahead aggressively
+        madvise(data, mapped.size_, MADV_SEQUENTIAL);
+    }
+
+    mapped.is_open_ = true;
+    return mapped;
+}
+
+MappedFile MappedFile::create(const std::string &path, size_t size)
+{
+    MappedFile mapped;
+    mapped.fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (mapped.fd_ < 0)
+        return mapped;
+    mapped.writable_ = true;
+
+    if (ftruncate(mapped.fd_, static_cast<off_t>(size)) != 0)
+        return {};
+
+    mapped.size_ = size;
+    if (size != 0)
+    {
+        void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, mapped.fd_, 0);
+        if (data == MAP_FAILED)
+            return {};
+        mapped.data_ = data;
+    }
+
+    mapped.is_open_ = true;
+    return mapped;
+}
+
+bool MappedFile::close(size_t size)
+{
+    if (!is_open_ || !writable_)
+        return false;
+
+    bool unmapped = !data_ || munmap(data_, size_) == 0;
+    data_ = nullptr;
+
+    bool truncated = ftruncate(fd_, static_cast<off_t>(size)) == 0;
+    bool closed = ::close(fd_) == 0;
+    fd_ = -1;
+    is_open_ = false;
+
+    return unmapped && truncated && closed;
+}
+
+void MappedFile::unmap()
+{
+    if (data_)
+        munmap(data_, size_);
+    if (fd_ >= 0)
+        ::close(fd_);
+    data_ = nullptr;
+    fd_ = -1;
+    is_open_ = false;
+}
+#endif
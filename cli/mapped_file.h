@@ -0,0 +1,43 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <span>
+#include <string>
+
+// a whole file mapped into memory; not open if the file could not be mapped, e.g. a pipe
+class MappedFile
+{
+public:
+    // maps an existing file read-only
+    static MappedFile open(const std::string &path);
+    // creates or truncates `path` to `size` bytes and maps it writable
+    static MappedFile create(const std::string &path, size_t size);
+
+    MappedFile() = default;
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+    ~MappedFile();
+
+    bool is_open() const { return is_open_; }
+    std::span<std::byte> data() const { return {static_cast<std::byte *>(data_), size_}; }
+
+    // unmaps a file from `create` and cuts it to the `size` bytes actually written
+    bool close(size_t size);
+
+private:
+    void unmap();
+
+    void *data_ = nullptr;
+    size_t size_ = 0;
+    bool is_open_ = false;
+    bool writable_ = false;
+#ifdef _WIN32
+    void *file_ = nullptr;
+    void *mapping_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+};
+
+#endif // MAPPED_FILE_H
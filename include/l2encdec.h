@@ -5,12 +5,19 @@
 #define L2ENCDEC_API
 #endif
 
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <span>
 #include <string>
 #include <vector>
 
 namespace l2encdec
 {
-const int SUPPORTED_PROTOCOLS[] = {111, 120, 121, 211, 212, 411, 412, 413, 414};
+constexpr int SUPPORTED_PROTOCOLS[] = {111, 120, 121, 211, 212, 411, 412, 413, 414};
 
 enum class Type
 {
@@ -34,6 +41,8 @@ enum class DecodeResult
     INVALID_TYPE = -1,
     DECOMPRESSION_FAILED = -2,
     DECRYPTION_FAILED = -3,
+    BUFFER_TOO_SMALL = -4,
+    ALREADY_FINISHED = -5,
 };
 
 enum class EncodeResult
@@ -42,6 +51,32 @@ enum class EncodeResult
     INVALID_TYPE = -1,
     COMPRESSION_FAILED = -2,
     ENCRYPTION_FAILED = -3,
+    BUFFER_TOO_SMALL = -4,
+    ALREADY_FINISHED = -5,
+};
+
+/**
+ * @brief Where the time of encode and decode calls went, see `Params::stats`.
+ * @details Calls add to the fields, so one instance can total many calls; it is not synchronized, so use one per
+ *          thread. Stage times are summed over every thread that worked on the stage, so with several threads they
+ *          can add up to more than `total`.
+ */
+struct Stats
+{
+    std::chrono::nanoseconds total{};      // wall time of the calls
+    std::chrono::nanoseconds copy{};       // header, tail and RSA body copies
+    std::chrono::nanoseconds transform{};  // XOR and Blowfish
+    std::chrono::nanoseconds deflate{};    // l2encdec::Type::RSA encode, including sealing the blocks
+    std::chrono::nanoseconds inflate{};    // l2encdec::Type::RSA decode
+    std::chrono::nanoseconds rsa{};        // modular exponentiation
+    std::chrono::nanoseconds padding{};    // removing RSA block padding
+    std::chrono::nanoseconds checksum{};   // CRC-32 of the tail
+    size_t bytes_in = 0;
+    size_t bytes_out = 0;
+    size_t rsa_blocks = 0;
+    size_t threads = 0;          // most threads that worked on one call
+    size_t allocations = 0;      // input-sized buffers the library allocated
+    size_t peak_buffer_size = 0; // largest of those buffers, in bytes
 };
 
 struct Params
@@ -59,8 +94,16 @@ struct Params
     std::string rsa_modulus;          // for l2encdec::Type::RSA
     std::string rsa_public_exponent;  // for l2encdec::Type::RSA, encrypt
     std::string rsa_private_exponent; // for l2encdec::Type::RSA, decrypt
+    int compression_level = 9;        // for l2encdec::Type::RSA, encrypt: zlib level from 0 (stored) to 9 (smallest), 1 is fastest
+    Stats *stats = nullptr;           // when set, the one-shot and in-place encode and decode calls add their timings here
+    // for l2encdec::Type::RSA: where the scratch buffers of encoding and decoding come from, only ever allocated on
+    // the calling thread; null uses std::pmr::get_default_resource()
+    std::pmr::memory_resource *memory_resource = nullptr;
 };
 
+// receives the output of l2encdec::Encoder and l2encdec::Decoder in order
+using Writer = std::function<void(std::span<const std::byte> data)>;
+
 /**
  * @brief Initialize default parameters for the specified protocol.
  * @param params Struct to populate with parameters
@@ -73,11 +116,29 @@ struct Params
  */
 L2ENCDEC_API bool init_params(Params &params, int protocol, const std::string &filename = "", bool use_legacy_decrypt_rsa = false);
 
+/**
+ * @brief Limit the worker threads used by RSA and large Blowfish inputs, including the calling thread.
+ * @param count Maximum number of threads; 0 (default) uses all hardware threads
+ */
+L2ENCDEC_API void set_max_threads(size_t count);
+
+/**
+ * @brief Memory resource backing allocations of 2 MiB and more with transparent huge pages, for `Params::memory_resource`.
+ * @details Fewer TLB misses on large inputs. Smaller allocations, and all of them where the system has no
+ *          transparent huge pages, go to `std::pmr::new_delete_resource()`. Thread-safe; never destroyed.
+ */
+L2ENCDEC_API std::pmr::memory_resource *huge_page_resource();
+
 /**
  * @brief Verify the checksum of the input data.
  */
 L2ENCDEC_API ChecksumResult verify_checksum(const std::vector<unsigned char> &input_data);
 
+/**
+ * @brief Verify the checksum of the input data in place.
+ */
+L2ENCDEC_API ChecksumResult verify_checksum(std::span<const std::byte> input_data);
+
 /**
  * @brief Encode the input data using params.
  */
@@ -85,6 +146,16 @@ L2ENCDEC_API EncodeResult encode(const std::vector<unsigned char> &input_data,
                                  std::vector<unsigned char> &output_data,
                                  const Params &params);
 
+/**
+ * @brief Encode many inputs with the same params.
+ * @details For l2encdec::Type::RSA the blocks of all inputs are encrypted together across all cores, so small
+ *          files do not leave threads idle and the key is set up once per batch.
+ * @return The first failure; `outputs_data` is only modified on success.
+ */
+L2ENCDEC_API EncodeResult encode_batch(const std::vector<std::vector<unsigned char>> &inputs_data,
+                                       std::vector<std::vector<unsigned char>> &outputs_data,
+                                       const Params &params);
+
 /**
  * @brief Decode the input data using params.
  */
@@ -92,6 +163,69 @@ L2ENCDEC_API DecodeResult decode(const std::vector<unsigned char> &input_data,
                                  std::vector<unsigned char> &output_data,
                                  const Params &params);
 
+/**
+ * @brief Upper bound of the encoded size of `input_size` bytes, for sizing the output of the span `encode`.
+ */
+L2ENCDEC_API size_t encoded_size_bound(size_t input_size, const Params &params);
+
+/**
+ * @brief Encode the input data into a caller-provided buffer.
+ * @param written Bytes written on success, or the required size on `EncodeResult::BUFFER_TOO_SMALL`
+ */
+L2ENCDEC_API EncodeResult encode(std::span<const std::byte> input_data,
+                                 std::span<std::byte> output_data,
+                                 size_t &written,
+                                 const Params &params);
+
+/**
+ * @brief Encode a length-preserving type (everything except l2encdec::Type::RSA) inside `data`.
+ * @param data Holds `input_size` plain bytes at its start, and room for the header and tail after them;
+ *        `encoded_size_bound` gives the exact size needed
+ * @param written Encoded size on success, or the required size on `EncodeResult::BUFFER_TOO_SMALL`
+ */
+L2ENCDEC_API EncodeResult encode_inplace(std::span<std::byte> data,
+                                         size_t input_size,
+                                         size_t &written,
+                                         const Params &params);
+
+/**
+ * @brief Decode a length-preserving type (everything except l2encdec::Type::RSA) inside `data`.
+ * @param payload Set to the decoded sub-range of `data` between header and tail
+ */
+L2ENCDEC_API DecodeResult decode_inplace(std::span<std::byte> data,
+                                         std::span<std::byte> &payload,
+                                         const Params &params);
+
+/**
+ * @brief Exact number of bytes the span `decode` writes for the input data.
+ * @details For l2encdec::Type::RSA only the first block is decrypted to read the stored size.
+ */
+L2ENCDEC_API DecodeResult decoded_size(std::span<const std::byte> input_data,
+                                       size_t &size,
+                                       const Params &params);
+
+/**
+ * @brief Decode the input data into a caller-provided buffer.
+ * @details Only l2encdec::Type::RSA needs a scratch buffer, for the decrypted zlib stream.
+ * @param written Bytes written on success, or the required size on `DecodeResult::BUFFER_TOO_SMALL`
+ */
+L2ENCDEC_API DecodeResult decode(std::span<const std::byte> input_data,
+                                 std::span<std::byte> output_data,
+                                 size_t &written,
+                                 const Params &params);
+
+/**
+ * @brief Same as the span `decode`, verifying the checksum in the same pass over the input.
+ * @details Each slice of the payload is checksummed right before it is decoded, instead of reading the whole input
+ *          twice. l2encdec::Type::RSA still checksums the input separately, next to the much slower decryption.
+ * @param checksum Result of `verify_checksum` on the input, set when decoding succeeds
+ */
+L2ENCDEC_API DecodeResult decode(std::span<const std::byte> input_data,
+                                 std::span<std::byte> output_data,
+                                 size_t &written,
+                                 ChecksumResult &checksum,
+                                 const Params &params);
+
 /**
  * @brief Decode input data using protocol-derived parameters.
  */
@@ -110,6 +244,126 @@ L2ENCDEC_API EncodeResult encode(const std::vector<unsigned char> &input,
                                  int protocol,
                                  const std::string &filename = "", // only used for protocol 121
                                  bool use_legacy_decrypt_rsa = false);
+
+/**
+ * @brief Params checked and expanded once, for encoding and decoding many files with the same settings.
+ * @details The keys are parsed, the Blowfish key schedule and the XOR key are computed and the header and tail are
+ *          laid out when the codec is built, so a call only does the work for its input. The calls behave like the
+ *          free functions with the same names and may run concurrently, unless `Params::stats` is set. Copies share
+ *          the prepared state.
+ */
+class L2ENCDEC_API Codec
+{
+public:
+    explicit Codec(const Params &params);
+
+    /**
+     * @brief Codec for the parameters `init_params` gives; if it fails, every call returns `INVALID_TYPE`.
+     */
+    explicit Codec(int protocol, const std::string &filename = "", bool use_legacy_decrypt_rsa = false);
+
+    /**
+     * @return `false` if the codec was built from a protocol `init_params` rejects.
+     */
+    bool is_valid() const;
+    const Params &params() const;
+
+    EncodeResult encode(const std::vector<unsigned char> &input_data, std::vector<unsigned char> &output_data) const;
+    size_t encoded_size_bound(size_t input_size) const;
+    EncodeResult encode(std::span<const std::byte> input_data,
+                        std::span<std::byte> output_data,
+                        size_t &written) const;
+    EncodeResult encode_inplace(std::span<std::byte> data, size_t input_size, size_t &written) const;
+
+    DecodeResult decode(const std::vector<unsigned char> &input_data, std::vector<unsigned char> &output_data) const;
+    DecodeResult decoded_size(std::span<const std::byte> input_data, size_t &size) const;
+    DecodeResult decode(std::span<const std::byte> input_data,
+                        std::span<std::byte> output_data,
+                        size_t &written) const;
+    DecodeResult decode(std::span<const std::byte> input_data,
+                        std::span<std::byte> output_data,
+                        size_t &written,
+                        ChecksumResult &checksum) const;
+    DecodeResult decode_inplace(std::span<std::byte> data, std::span<std::byte> &payload) const;
+
+private:
+    struct State;
+    std::shared_ptr<const State> state_;
+};
+
+/**
+ * @brief Encode a file that arrives in pieces, writing the header, body and tail as soon as they are known.
+ * @details Apart from a partial Blowfish block, every fed byte is passed on before `feed` returns.
+ *          l2encdec::Type::RSA stores the uncompressed size in front of the compressed stream, so without
+ *          `input_size` the whole input is held until `finish`.
+ */
+class L2ENCDEC_API Encoder
+{
+public:
+    static constexpr size_t UNKNOWN_SIZE = SIZE_MAX;
+
+    /**
+     * @param writer Receives the encoded file in order
+     * @param input_size Total bytes that will be fed, lets l2encdec::Type::RSA stream its output
+     */
+    Encoder(const Params &params, Writer writer, size_t input_size = UNKNOWN_SIZE);
+    ~Encoder();
+
+    Encoder(const Encoder &) = delete;
+    Encoder &operator=(const Encoder &) = delete;
+
+    /**
+     * @return The first failure, which every later call returns as well; `ALREADY_FINISHED` after `finish`.
+     */
+    EncodeResult feed(std::span<const std::byte> input_data);
+
+    /**
+     * @brief Write the rest of the body and the tail; fails if a known `input_size` was not met.
+     * @return `ALREADY_FINISHED` when called again.
+     */
+    EncodeResult finish();
+
+private:
+    struct State;
+    std::unique_ptr<State> state_;
+};
+
+/**
+ * @brief Decode a file that arrives in pieces, passing the payload on as soon as it is known not to be the tail.
+ * @details The decoded bytes are written before the checksum can be verified, see `verify_checksum`.
+ */
+class L2ENCDEC_API Decoder
+{
+public:
+    /**
+     * @param writer Receives the decoded payload in order
+     */
+    Decoder(const Params &params, Writer writer);
+    ~Decoder();
+
+    Decoder(const Decoder &) = delete;
+    Decoder &operator=(const Decoder &) = delete;
+
+    /**
+     * @return The first failure, which every later call returns as well; `ALREADY_FINISHED` after `finish`.
+     */
+    DecodeResult feed(std::span<const std::byte> input_data);
+
+    /**
+     * @brief Decode the rest of the payload once all of the file was fed.
+     * @return `ALREADY_FINISHED` when called again.
+     */
+    DecodeResult finish();
+
+    /**
+     * @brief Same as the free `verify_checksum` over everything fed; valid after `finish`.
+     */
+    ChecksumResult verify_checksum() const;
+
+private:
+    struct State;
+    std::unique_ptr<State> state_;
+};
 } // namespace l2encdec
 
 #endif // L2ENCDEC_PUBLIC_H
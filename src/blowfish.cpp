@@ -1,9 +1,34 @@
 #include "blowfish.h"
-#include <blowfish/blowfish.h>
+#include "blowfish_tables.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
 
 namespace
 {
 constexpr size_t BLOWFISH_BLOCK = 8;
+constexpr size_t ROUNDS = 16;
+// independent blocks in flight, enough to hide the S-box load latency of a round
+constexpr size_t INTERLEAVE = 8;
+// inputs below this are not worth waking the pool for
+constexpr size_t PARALLEL_THRESHOLD = 256 * 1024;
+constexpr size_t BLOCKS_PER_TASK = 64 * 1024 / BLOWFISH_BLOCK;
+
+constexpr size_t KEY_CACHE_CAPACITY = 16;
+} // namespace
+
+struct blowfish::Key
+{
+    std::array<uint32_t, ROUNDS + 2> p;
+    std::array<std::array<uint32_t, 256>, 4> s;
+};
+
+namespace
+{
+using Schedule = blowfish::Key;
 
 inline uint32_t read_u32(const unsigned char *p)
 {
@@ -21,44 +46,172 @@ inline void write_u32(uint32_t v, unsigned char *p)
     p[3] = (v >> 24) & 0xFF;
 }
 
-template <void (Blowfish::*Func)(uint32_t &, uint32_t &)>
-size_t process(const std::vector<unsigned char> &input_data,
-               std::vector<unsigned char> &output_data,
-               std::string key)
+inline uint32_t f(const Schedule &ks, uint32_t x)
 {
-    output_data = input_data;
+    return ((ks.s[0][x >> 24] + ks.s[1][(x >> 16) & 0xFF]) ^ ks.s[2][(x >> 8) & 0xFF]) + ks.s[3][x & 0xFF];
+}
 
-    if (key.empty() || key.back() != '\0')
-        key.push_back('\0');
+// runs N blocks through the rounds side by side; two rounds per step so no swaps are needed
+template <bool Decrypt, size_t N>
+inline void crypt(const Schedule &ks, uint32_t (&l)[N], uint32_t (&r)[N])
+{
+    for (size_t round = 0; round < ROUNDS; round += 2)
+    {
+        uint32_t p0 = Decrypt ? ks.p[ROUNDS + 1 - round] : ks.p[round];
+        uint32_t p1 = Decrypt ? ks.p[ROUNDS - round] : ks.p[round + 1];
 
-    Blowfish bf(key);
+        for (size_t i = 0; i < N; ++i)
+        {
+            l[i] ^= p0;
+            r[i] ^= f(ks, l[i]);
+        }
+        for (size_t i = 0; i < N; ++i)
+        {
+            r[i] ^= p1;
+            l[i] ^= f(ks, r[i]);
+        }
+    }
 
-    size_t full_blocks = input_data.size() / BLOWFISH_BLOCK;
-    for (size_t i = 0; i < full_blocks * BLOWFISH_BLOCK; i += BLOWFISH_BLOCK)
+    uint32_t p_last = Decrypt ? ks.p[1] : ks.p[ROUNDS];
+    uint32_t p_final = Decrypt ? ks.p[0] : ks.p[ROUNDS + 1];
+    for (size_t i = 0; i < N; ++i)
     {
-        uint32_t left = read_u32(&output_data[i]);
-        uint32_t right = read_u32(&output_data[i + 4]);
+        uint32_t left = l[i] ^ p_last;
+        l[i] = r[i] ^ p_final;
+        r[i] = left;
+    }
+}
 
-        (bf.*Func)(left, right);
+template <bool Decrypt, size_t N>
+inline void crypt_blocks(const Schedule &ks, const unsigned char *input, unsigned char *output)
+{
+    uint32_t l[N], r[N];
+    for (size_t i = 0; i < N; ++i)
+    {
+        l[i] = read_u32(input + i * BLOWFISH_BLOCK);
+        r[i] = read_u32(input + i * BLOWFISH_BLOCK + 4);
+    }
 
-        write_u32(left, &output_data[i]);
-        write_u32(right, &output_data[i + 4]);
+    crypt<Decrypt>(ks, l, r);
+
+    for (size_t i = 0; i < N; ++i)
+    {
+        write_u32(l[i], output + i * BLOWFISH_BLOCK);
+        write_u32(r[i], output + i * BLOWFISH_BLOCK + 4);
     }
+}
 
-    return output_data.size();
+// `size` must be a multiple of BLOWFISH_BLOCK
+template <bool Decrypt>
+void crypt_range(const Schedule &ks, const unsigned char *in, unsigned char *out, size_t size)
+{
+    size_t i = 0;
+    for (; i + INTERLEAVE * BLOWFISH_BLOCK <= size; i += INTERLEAVE * BLOWFISH_BLOCK)
+        crypt_blocks<Decrypt, INTERLEAVE>(ks, in + i, out + i);
+    for (; i < size; i += BLOWFISH_BLOCK)
+        crypt_blocks<Decrypt, 1>(ks, in + i, out + i);
+}
+
+// standard Blowfish key expansion; the key bytes are cycled over P and then the schedule encrypts itself
+void expand_key(Schedule &ks, const std::string &key)
+{
+    ks.p = blowfish_tables::P;
+    ks.s = blowfish_tables::S;
+
+    for (size_t i = 0, k = 0; i < ks.p.size(); ++i)
+    {
+        uint32_t word = 0;
+        for (size_t b = 0; b < 4; ++b, k = (k + 1) % key.size())
+            word = (word << 8) | static_cast<unsigned char>(key[k]);
+        ks.p[i] ^= word;
+    }
+
+    uint32_t l[1] = {0}, r[1] = {0};
+    for (size_t i = 0; i < ks.p.size(); i += 2)
+    {
+        crypt<false>(ks, l, r);
+        ks.p[i] = l[0];
+        ks.p[i + 1] = r[0];
+    }
+    for (auto &sbox : ks.s)
+        for (size_t i = 0; i < sbox.size(); i += 2)
+        {
+            crypt<false>(ks, l, r);
+            sbox[i] = l[0];
+            sbox[i + 1] = r[0];
+        }
+}
+
+template <bool Decrypt>
+void process(std::span<const unsigned char> input_data,
+             std::span<unsigned char> output_data,
+             const Schedule &ks)
+{
+    const unsigned char *in = input_data.data();
+    unsigned char *out = output_data.data();
+    size_t full_size = input_data.size() / BLOWFISH_BLOCK * BLOWFISH_BLOCK;
+    if (full_size < PARALLEL_THRESHOLD)
+        crypt_range<Decrypt>(ks, in, out, full_size);
+    else
+        thread_pool::parallel_for(full_size / BLOWFISH_BLOCK, BLOCKS_PER_TASK, [&](size_t begin, size_t end)
+                                  { crypt_range<Decrypt>(ks, in + begin * BLOWFISH_BLOCK, out + begin * BLOWFISH_BLOCK, (end - begin) * BLOWFISH_BLOCK); });
+
+    if (in != out)
+        std::copy(input_data.begin() + full_size, input_data.end(), output_data.begin() + full_size);
 }
 } // namespace
 
+std::shared_ptr<const blowfish::Key> blowfish::load_key(const std::string &key)
+{
+    static std::mutex mutex;
+    static std::unordered_map<std::string, std::shared_ptr<const Key>> cache;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (auto it = cache.find(key); it != cache.end())
+        return it->second;
+
+    // the game hashes the key with its NUL terminator
+    std::string terminated = key;
+    if (terminated.empty() || terminated.back() != '\0')
+        terminated.push_back('\0');
+
+    auto schedule = std::make_shared<Key>();
+    expand_key(*schedule, terminated);
+
+    if (cache.size() >= KEY_CACHE_CAPACITY)
+        cache.clear();
+    cache.emplace(key, schedule);
+    return schedule;
+}
+
 size_t blowfish::encrypt(const std::vector<unsigned char> &input_data,
                          std::vector<unsigned char> &output_data,
-                         std::string key)
+                         const std::string &key)
 {
-    return process<&Blowfish::encrypt>(input_data, output_data, key);
+    output_data.resize(input_data.size());
+    encrypt(input_data, output_data, *load_key(key));
+    return output_data.size();
 }
 
 size_t blowfish::decrypt(const std::vector<unsigned char> &input_data,
                          std::vector<unsigned char> &output_data,
-                         std::string key)
+                         const std::string &key)
+{
+    output_data.resize(input_data.size());
+    decrypt(input_data, output_data, *load_key(key));
+    return output_data.size();
+}
+
+void blowfish::encrypt(std::span<const unsigned char> input_data,
+                       std::span<unsigned char> output_data,
+                       const Key &key)
+{
+    process<false>(input_data, output_data, key);
+}
+
+void blowfish::decrypt(std::span<const unsigned char> input_data,
+                       std::span<unsigned char> output_data,
+                       const Key &key)
 {
-    return process<&Blowfish::decrypt>(input_data, output_data, key);
+    process<true>(input_data, output_data, key);
 }
@@ -2,13 +2,22 @@
 #define BLOWFISH_H
 
 #include <cstddef>
+#include <memory>
+#include <span>
 #include <string>
 #include <vector>
 
 namespace blowfish
 {
-size_t encrypt(const std::vector<unsigned char> &input_data, std::vector<unsigned char> &output_data, std::string key);
-size_t decrypt(const std::vector<unsigned char> &input_data, std::vector<unsigned char> &output_data, std::string key);
+struct Key;
+
+// expanded key schedule, computed once per key and shared afterwards
+std::shared_ptr<const Key> load_key(const std::string &key);
+size_t encrypt(const std::vector<unsigned char> &input_data, std::vector<unsigned char> &output_data, const std::string &key);
+size_t decrypt(const std::vector<unsigned char> &input_data, std::vector<unsigned char> &output_data, const std::string &key);
+// `output_data` must be at least `input_data.size()` bytes and may alias `input_data`; a trailing partial block is copied as is
+void encrypt(std::span<const unsigned char> input_data, std::span<unsigned char> output_data, const Key &key);
+void decrypt(std::span<const unsigned char> input_data, std::span<unsigned char> output_data, const Key &key);
 } // namespace blowfish
 
 #endif // BLOWFISH_H
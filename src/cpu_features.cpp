@@ -0,0 +1,90 @@
+#include "cpu_features.h"
+
+#if defined(L2ENCDEC_X86) && defined(_MSC_VER) && !defined(__clang__)
+#include <immintrin.h>
+#include <intrin.h>
+#elif defined(L2ENCDEC_ARM64) && defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#elif defined(L2ENCDEC_ARM64) && defined(__linux__)
+#include <sys/auxv.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#endif
+
+namespace
+{
+struct Features
+{
+    bool sse2 = false;
+    bool avx2 = false;
+    bool pclmul = false;
+    bool crc32 = false;
+};
+
+Features detect()
+{
+    Features f;
+#if defined(L2ENCDEC_X86) && defined(_MSC_VER) && !defined(__clang__)
+    int regs[4];
+    __cpuid(regs, 0);
+    int max_leaf = regs[0];
+
+    __cpuid(regs, 1);
+    f.sse2 = (regs[3] & (1 << 26)) != 0;
+    f.pclmul = (regs[2] & (1 << 1)) != 0;
+    bool os_saves_ymm = (regs[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+
+    if (max_leaf >= 7 && os_saves_ymm)
+    {
+        __cpuidex(regs, 7, 0);
+        f.avx2 = (regs[1] & (1 << 5)) != 0;
+    }
+#elif defined(L2ENCDEC_X86)
+    __builtin_cpu_init();
+    f.sse2 = __builtin_cpu_supports("sse2");
+    f.avx2 = __builtin_cpu_supports("avx2");
+    f.pclmul = __builtin_cpu_supports("pclmul");
+#elif defined(L2ENCDEC_ARM64) && defined(_WIN32)
+    f.crc32 = IsProcessorFeaturePresent(PF_ARM_V8_CRC32_INSTRUCTIONS_AVAILABLE) != 0;
+#elif defined(L2ENCDEC_ARM64) && defined(__linux__)
+    f.crc32 = (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#elif defined(L2ENCDEC_ARM64) && defined(__APPLE__)
+    // every Apple arm64 CPU has them
+    f.crc32 = true;
+#endif
+    return f;
+}
+
+const Features &features()
+{
+    static const Features f = detect();
+    return f;
+}
+} // namespace
+
+bool cpu_features::has_sse2()
+{
+    return features().sse2;
+}
+
+bool cpu_features::has_avx2()
+{
+    return features().avx2;
+}
+
+bool cpu_features::has_pclmul()
+{
+    return features().pclmul;
+}
+
+bool cpu_features::has_crc32()
+{
+    return features().crc32;
+}
@@ -0,0 +1,27 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define L2ENCDEC_X86 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define L2ENCDEC_ARM64 1
+#endif
+
+// lets a single function use instructions beyond the compiler's baseline; MSVC needs no flag for intrinsics
+#if defined(__GNUC__) || defined(__clang__)
+#define L2ENCDEC_TARGET(features) __attribute__((target(features)))
+#else
+#define L2ENCDEC_TARGET(features)
+#endif
+
+namespace cpu_features
+{
+bool has_sse2();
+bool has_avx2();
+// carry-less multiply, x86 only
+bool has_pclmul();
+// ARMv8 CRC32 instructions, AArch64 only
+bool has_crc32();
+} // namespace cpu_features
+
+#endif // CPU_FEATURES_H
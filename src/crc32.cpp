@@ -0,0 +1,207 @@
+#include "crc32.h"
+#include "cpu_features.h"
+#include <array>
+#include <cstring>
+
+#if defined(L2ENCDEC_X86)
+#include <immintrin.h>
+#elif defined(L2ENCDEC_ARM64) && defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#elif defined(L2ENCDEC_ARM64)
+#include <arm_acle.h>
+#endif
+
+namespace
+{
+// reflected CRC-32 polynomial
+constexpr uint32_t POLY = 0xEDB88320;
+constexpr size_t SLICES = 16;
+
+// works on the inverted CRC register; `update` does the inversions
+using Kernel = uint32_t (*)(uint32_t crc, const unsigned char *data, size_t size);
+
+using Tables = std::array<std::array<uint32_t, 256>, SLICES>;
+
+// tables[k][b] is the CRC register after byte b followed by k zero bytes
+Tables make_tables()
+{
+    Tables tables{};
+    for (uint32_t b = 0; b < 256; ++b)
+    {
+        uint32_t crc = b;
+        for (int bit = 0; bit < 8; ++bit)
+            crc = crc & 1 ? (crc >> 1) ^ POLY : crc >> 1;
+        tables[0][b] = crc;
+    }
+    for (size_t k = 1; k < SLICES; ++k)
+        for (size_t b = 0; b < 256; ++b)
+            tables[k][b] = (tables[k - 1][b] >> 8) ^ tables[0][tables[k - 1][b] & 0xFF];
+    return tables;
+}
+
+const Tables &tables()
+{
+    static const Tables t = make_tables();
+    return t;
+}
+
+uint32_t load_le32(const unsigned char *p)
+{
+    return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 |
+           static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+uint32_t crc_bytes(uint32_t crc, const unsigned char *data, size_t size)
+{
+    const auto &t = tables();
+    for (size_t i = 0; i < size; ++i)
+        crc = t[0][(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+uint32_t crc_slice16(uint32_t crc, const unsigned char *data, size_t size)
+{
+    const auto &t = tables();
+    for (; size >= SLICES; data += SLICES, size -= SLICES)
+    {
+        uint32_t a = load_le32(data) ^ crc;
+        uint32_t b = load_le32(data + 4);
+        uint32_t c = load_le32(data + 8);
+        uint32_t d = load_le32(data + 12);
+        crc = t[15][a & 0xFF] ^ t[14][(a >> 8) & 0xFF] ^ t[13][(a >> 16) & 0xFF] ^ t[12][a >> 24] ^
+              t[11][b & 0xFF] ^ t[10][(b >> 8) & 0xFF] ^ t[9][(b >> 16) & 0xFF] ^ t[8][b >> 24] ^
+              t[7][c & 0xFF] ^ t[6][(c >> 8) & 0xFF] ^ t[5][(c >> 16) & 0xFF] ^ t[4][c >> 24] ^
+              t[3][d & 0xFF] ^ t[2][(d >> 8) & 0xFF] ^ t[1][(d >> 16) & 0xFF] ^ t[0][d >> 24];
+    }
+    return crc_bytes(crc, data, size);
+}
+
+#if defined(L2ENCDEC_X86)
+// folds 64 bytes per step with carry-less multiplies, then Barrett-reduces to 32 bits; constants from
+// Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction", bit-reflected
+constexpr size_t FOLD_MIN_SIZE = 64;
+
+L2ENCDEC_TARGET("sse2")
+inline __m128i load(const unsigned char *p)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+
+// `x` times `k`, low half by the low constant and high half by the high one, added to `next`
+L2ENCDEC_TARGET("pclmul,sse2")
+inline __m128i fold(__m128i x, __m128i k, __m128i next)
+{
+    return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00), _mm_clmulepi64_si128(x, k, 0x11)), next);
+}
+
+L2ENCDEC_TARGET("pclmul,sse2")
+uint32_t crc_pclmul(uint32_t crc, const unsigned char *data, size_t size)
+{
+    if (size < FOLD_MIN_SIZE)
+        return crc_slice16(crc, data, size);
+
+    alignas(16) static const uint64_t k1k2[] = {0x0154442bd4, 0x01c6e41596};
+    alignas(16) static const uint64_t k3k4[] = {0x01751997d0, 0x00ccaa009e};
+    alignas(16) static const uint64_t k5k0[] = {0x0163cd6124, 0x0000000000};
+    alignas(16) static const uint64_t poly[] = {0x01db710641, 0x01f7011641};
+
+    __m128i x1 = _mm_xor_si128(load(data), _mm_cvtsi32_si128(static_cast<int>(crc)));
+    __m128i x2 = load(data + 16);
+    __m128i x3 = load(data + 32);
+    __m128i x4 = load(data + 48);
+    data += 64;
+    size -= 64;
+
+    __m128i k = _mm_load_si128(reinterpret_cast<const __m128i *>(k1k2));
+    for (; size >= 64; data += 64, size -= 64)
+    {
+        x1 = fold(x1, k, load(data));
+        x2 = fold(x2, k, load(data + 16));
+        x3 = fold(x3, k, load(data + 32));
+        x4 = fold(x4, k, load(data + 48));
+    }
+
+    k = _mm_load_si128(reinterpret_cast<const __m128i *>(k3k4));
+    x1 = fold(x1, k, x2);
+    x1 = fold(x1, k, x3);
+    x1 = fold(x1, k, x4);
+    for (; size >= 16; data += 16, size -= 16)
+        x1 = fold(x1, k, load(data));
+
+    // 128 to 64 bits
+    __m128i low32 = _mm_setr_epi32(-1, 0, -1, 0);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), _mm_clmulepi64_si128(x1, k, 0x10));
+    k = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(k5k0));
+    x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, low32), k, 0x00), _mm_srli_si128(x1, 4));
+
+    // Barrett reduction to 32 bits
+    k = _mm_load_si128(reinterpret_cast<const __m128i *>(poly));
+    __m128i t = _mm_clmulepi64_si128(_mm_and_si128(x1, low32), k, 0x10);
+    t = _mm_clmulepi64_si128(_mm_and_si128(t, low32), k, 0x00);
+    x1 = _mm_xor_si128(x1, t);
+
+    crc = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(x1, 4)));
+    return crc_slice16(crc, data, size);
+}
+#elif defined(L2ENCDEC_ARM64)
+#if defined(__clang__)
+#define L2ENCDEC_TARGET_CRC L2ENCDEC_TARGET("crc")
+#else
+#define L2ENCDEC_TARGET_CRC L2ENCDEC_TARGET("+crc")
+#endif
+
+// the ARMv8 CRC32 instructions implement this exact polynomial, 8 bytes at a time
+L2ENCDEC_TARGET_CRC
+uint32_t crc_armv8(uint32_t crc, const unsigned char *data, size_t size)
+{
+    for (; size >= sizeof(uint64_t); data += sizeof(uint64_t), size -= sizeof(uint64_t))
+    {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        crc = __crc32d(crc, word);
+    }
+    for (; size > 0; ++data, --size)
+        crc = __crc32b(crc, *data);
+    return crc;
+}
+#endif
+
+struct Selected
+{
+    Kernel kernel;
+    const char *name;
+};
+
+Selected select_kernel()
+{
+#if defined(L2ENCDEC_X86)
+    if (cpu_features::has_pclmul())
+        return {crc_pclmul, "pclmul"};
+#elif defined(L2ENCDEC_ARM64)
+    if (cpu_features::has_crc32())
+        return {crc_armv8, "armv8-crc"};
+#endif
+    return {crc_slice16, "slice-by-16"};
+}
+
+const Selected &selected()
+{
+    static const Selected s = select_kernel();
+    return s;
+}
+} // namespace
+
+uint32_t crc32::update(uint32_t crc, std::span<const unsigned char> data)
+{
+    return ~selected().kernel(~crc, data.data(), data.size());
+}
+
+uint32_t crc32::update_portable(uint32_t crc, std::span<const unsigned char> data)
+{
+    return ~crc_slice16(~crc, data.data(), data.size());
+}
+
+const char *crc32::kernel_name()
+{
+    return selected().name;
+}
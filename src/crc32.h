@@ -0,0 +1,17 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <cstdint>
+#include <span>
+
+namespace crc32
+{
+// CRC-32 as computed by zlib, continuing from `crc`, which is 0 for the first piece
+uint32_t update(uint32_t crc, std::span<const unsigned char> data);
+// slice-by-16 tables, used by `update` when the CPU has no carry-less multiply or CRC instructions
+uint32_t update_portable(uint32_t crc, std::span<const unsigned char> data);
+// kernel picked by `update` on this CPU
+const char *kernel_name();
+} // namespace crc32
+
+#endif // CRC32_H
@@ -1,39 +1,614 @@
 #include "blowfish.h"
 #include "l2encdec_private.h" // IWYU pragma: keep
+#include "layout.h"
+#include "memory.h"
+#include "pipeline.h"
 #include "rsa.h"
+#include "stats.h"
+#include "thread_pool.h"
 #include "utils.h"
 #include "xor_utils.h"
 #include "zlib_utils.h"
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
 #include <cstring>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <span>
 #include <string_view>
-#include <unordered_map>
 
 namespace
 {
-constexpr size_t TAIL_SIZE = 20;
-constexpr size_t TAIL_CRC32_OFFSET = 12;
-constexpr std::string_view HEADER_PREFIX = "Lineage2Ver";
-constexpr size_t PROTOCOL_SIZE = 3;
-constexpr size_t HEADER_SIZE = (HEADER_PREFIX.size() + PROTOCOL_SIZE) * 2;
-
-const std::unordered_map<int, l2encdec::Params> PROTOCOL_CONFIGS = {
-    {111, {.type = l2encdec::Type::XOR, .xor_key = 0xAC}},
-    {120, {.type = l2encdec::Type::XOR_POSITION, .xor_start_position = 0xE6}},
-    {121, {.type = l2encdec::Type::XOR_FILENAME}},
-    {211, {.type = l2encdec::Type::BLOWFISH, .blowfish_key = "31==-%&@!^+][;'.]94-"}},
-    {212, {.type = l2encdec::Type::BLOWFISH, .blowfish_key = "[;'.]94-&@%!^+]-31=="}},
-    {411, {.type = l2encdec::Type::RSA, .rsa_modulus = "8c9d5da87b30f5d7cd9dc88c746eaac5bb180267fa11737358c4c95d9adf59dd37689f9befb251508759555d6fe0eca87bebe0a10712cf0ec245af84cd22eb4cb675e98eaf5799fca62a20a2baa4801d5d70718dcd43283b8428f1387aec6600f937bfc7bb72404d187d3a9c438f1ffce9ce365dccf754232ff6def038a41385", .rsa_private_exponent = "1d"}},
-    {412, {.type = l2encdec::Type::RSA, .rsa_modulus = "a465134799cf2c45087093e7d0f0f144e6d528110c08f674730d436e40827330eccea46e70acf10cdda7d8f710e3b44dcca931812d76cd7494289bca8b73823f57efc0515b97e4a2a02612ccfa719cf7885104b06f2e7e2cc967b62e3d3b1aadb925db94cbc8cd3070a4bb13f7e202c7733a67b1b94c1ebc0afcbe1a63b448cf", .rsa_private_exponent = "25"}},
-    {413, {.type = l2encdec::Type::RSA, .rsa_modulus = "97df398472ddf737ef0a0cd17e8d172f0fef1661a38a8ae1d6e829bc1c6e4c3cfc19292dda9ef90175e46e7394a18850b6417d03be6eea274d3ed1dde5b5d7bde72cc0a0b71d03608655633881793a02c9a67d9ef2b45eb7c08d4be329083ce450e68f7867b6749314d40511d09bc5744551baa86a89dc38123dc1668fd72d83", .rsa_private_exponent = "35"}},
-    {414, {.type = l2encdec::Type::RSA, .rsa_modulus = "ad70257b2316ce09dfaf2ebc3f63b3d673b0c98a403950e26bb87379b11e17aed0e45af23e7171e5ec1fbc8d1ae32ffb7801b31266eef9c334b53469d4b7cbe83284273d35a9aab49b453e7012f374496c65f8089f5d134b0eb3d1e3b22051ed5977a6dd68c4f85785dfcc9f4412c81681944fc4b8ce27caf0242deaa5762e8d", .rsa_private_exponent = "25"}}};
-
-const l2encdec::Params MODERN_RSA_PARAMS = {
+using layout::decode_tail_size;
+using layout::encode_tail_size;
+using layout::has_valid_header;
+using layout::header_size;
+
+// defaults of a protocol, see l2encdec::init_params; constant-initialized, so loading the library builds nothing
+struct ProtocolConfig
+{
+    int protocol;
+    l2encdec::Type type;
+    int xor_key = 0;
+    int xor_start_position = 0;
+    std::string_view blowfish_key = {};
+    std::string_view rsa_modulus = {};
+    std::string_view rsa_public_exponent = {};
+    std::string_view rsa_private_exponent = {};
+};
+
+constexpr ProtocolConfig PROTOCOL_CONFIGS[] = {
+    {.protocol = 111, .type = l2encdec::Type::XOR, .xor_key = 0xAC},
+    {.protocol = 120, .type = l2encdec::Type::XOR_POSITION, .xor_start_position = 0xE6},
+    {.protocol = 121, .type = l2encdec::Type::XOR_FILENAME},
+    {.protocol = 211, .type = l2encdec::Type::BLOWFISH, .blowfish_key = "31==-%&@!^+][;'.]94-"},
+    {.protocol = 212, .type = l2encdec::Type::BLOWFISH, .blowfish_key = "[;'.]94-&@%!^+]-31=="},
+    {.protocol = 411, .type = l2encdec::Type::RSA, .rsa_modulus = "8c9d5da87b30f5d7cd9dc88c746eaac5bb180267fa11737358c4c95d9adf59dd37689f9befb251508759555d6fe0eca87bebe0a10712cf0ec245af84cd22eb4cb675e98eaf5799fca62a20a2baa4801d5d70718dcd43283b8428f1387aec6600f937bfc7bb72404d187d3a9c438f1ffce9ce365dccf754232ff6def038a41385", .rsa_private_exponent = "1d"},
+    {.protocol = 412, .type = l2encdec::Type::RSA, .rsa_modulus = "a465134799cf2c45087093e7d0f0f144e6d528110c08f674730d436e40827330eccea46e70acf10cdda7d8f710e3b44dcca931812d76cd7494289bca8b73823f57efc0515b97e4a2a02612ccfa719cf7885104b06f2e7e2cc967b62e3d3b1aadb925db94cbc8cd3070a4bb13f7e202c7733a67b1b94c1ebc0afcbe1a63b448cf", .rsa_private_exponent = "25"},
+    {.protocol = 413, .type = l2encdec::Type::RSA, .rsa_modulus = "97df398472ddf737ef0a0cd17e8d172f0fef1661a38a8ae1d6e829bc1c6e4c3cfc19292dda9ef90175e46e7394a18850b6417d03be6eea274d3ed1dde5b5d7bde72cc0a0b71d03608655633881793a02c9a67d9ef2b45eb7c08d4be329083ce450e68f7867b6749314d40511d09bc5744551baa86a89dc38123dc1668fd72d83", .rsa_private_exponent = "35"},
+    {.protocol = 414, .type = l2encdec::Type::RSA, .rsa_modulus = "ad70257b2316ce09dfaf2ebc3f63b3d673b0c98a403950e26bb87379b11e17aed0e45af23e7171e5ec1fbc8d1ae32ffb7801b31266eef9c334b53469d4b7cbe83284273d35a9aab49b453e7012f374496c65f8089f5d134b0eb3d1e3b22051ed5977a6dd68c4f85785dfcc9f4412c81681944fc4b8ce27caf0242deaa5762e8d", .rsa_private_exponent = "25"},
+};
+
+constexpr ProtocolConfig MODERN_RSA_CONFIG = {
+    .protocol = 0,
     .type = l2encdec::Type::RSA,
     .rsa_modulus = "75b4d6de5c016544068a1acf125869f43d2e09fc55b8b1e289556daf9b8757635593446288b3653da1ce91c87bb1a5c18f16323495c55d7d72c0890a83f69bfd1fd9434eb1c02f3e4679edfa43309319070129c267c85604d87bb65bae205de3707af1d2108881abb567c3b3d069ae67c3a4c6a3aa93d26413d4c66094ae2039",
     .rsa_public_exponent = "30b4c2d798d47086145c75063c8e841e719776e400291d7838d3e6c4405b504c6a07f8fca27f32b86643d2649d1d5f124cdd0bf272f0909dd7352fe10a77b34d831043d9ae541f8263c6fe3d1c14c2f04e43a7253a6dda9a8c1562cbd493c1b631a1957618ad5dfe5ca28553f746e2fc6f2db816c7db223ec91e955081c1de65",
     .rsa_private_exponent = "1d",
 };
+
+constexpr const ProtocolConfig *find_protocol(int protocol)
+{
+    for (const auto &config : PROTOCOL_CONFIGS)
+        if (config.protocol == protocol)
+            return &config;
+    return nullptr;
+}
+
+constexpr bool covers_supported_protocols()
+{
+    if (std::size(PROTOCOL_CONFIGS) != std::size(l2encdec::SUPPORTED_PROTOCOLS))
+        return false;
+    for (int protocol : l2encdec::SUPPORTED_PROTOCOLS)
+        if (!find_protocol(protocol))
+            return false;
+    return true;
+}
+
+static_assert(covers_supported_protocols(), "PROTOCOL_CONFIGS and l2encdec::SUPPORTED_PROTOCOLS differ");
+
+// returns `size` bytes to write the output to, or an empty span if the destination is too small
+using Allocate = std::function<std::span<unsigned char>(size_t size)>;
+
+std::span<const unsigned char> as_uchars(std::span<const std::byte> data)
+{
+    return {reinterpret_cast<const unsigned char *>(data.data()), data.size()};
+}
+
+std::span<unsigned char> as_uchars(std::span<std::byte> data)
+{
+    return {reinterpret_cast<unsigned char *>(data.data()), data.size()};
+}
+
+// bytes transformed and checksummed per step, so the checksum reads them while they are still in cache;
+// a whole number of Blowfish blocks, below the size at which Blowfish goes parallel on its own
+constexpr size_t BODY_SLICE_SIZE = 64 * 1024;
+constexpr size_t BODY_SLICES_PER_TASK = 4;
+// get_key_by_index only looks at the low 16 bits of the index
+constexpr size_t XOR_KEYSTREAM_PERIOD = 0x10000;
+
+// everything a call needs from l2encdec::Params, with the keys loaded and the header and tail laid out
+struct Prepared
+{
+    l2encdec::Type type;
+    bool valid_header;
+    bool tail_has_checksum; // the tail written holds a checksum of the encoded data
+    size_t header_size;
+    size_t decode_tail_size;
+    std::vector<unsigned char> header = {}; // UTF-16LE
+    std::vector<unsigned char> tail = {};   // the custom tail, or the default one with its checksum still zero
+    int xor_key;
+    int xor_start_position;
+    int compression_level;
+    std::shared_ptr<const blowfish::Key> blowfish_key = {};
+    std::shared_ptr<const rsa::Key> rsa_public_key = {};
+    std::shared_ptr<const rsa::Key> rsa_private_key = {};
+    l2encdec::Stats *stats;
+    std::pmr::memory_resource *memory_resource;
+};
+
+enum class Direction
+{
+    ENCODE,
+    DECODE,
+    BOTH,
+};
+
+// loads only the keys `direction` needs; a key that fails to load is left null
+Prepared prepare(const l2encdec::Params &p, Direction direction)
+{
+    using l2encdec::Type;
+
+    Prepared prepared{
+        .type = p.type,
+        .valid_header = has_valid_header(p),
+        .tail_has_checksum = !p.skip_tail && p.tail.empty(),
+        .header_size = header_size(p),
+        .decode_tail_size = decode_tail_size(p),
+        .xor_key = p.type == Type::XOR_FILENAME ? xor_utils::get_key_by_filename(p.filename) : p.xor_key,
+        .xor_start_position = p.xor_start_position,
+        .compression_level = p.compression_level,
+        .stats = p.stats,
+        .memory_resource = p.memory_resource,
+    };
+
+    if (!p.skip_header && prepared.valid_header)
+    {
+        std::string header = layout::header(p);
+        prepared.header.resize(header.size() * 2);
+        utils::write_header(prepared.header.data(), header);
+    }
+
+    if (!p.skip_tail)
+    {
+        prepared.tail.resize(encode_tail_size(p));
+        if (!p.tail.empty())
+            utils::write_tail(prepared.tail.data(), p.tail);
+    }
+
+    bool encode = direction != Direction::DECODE;
+    bool decode = direction != Direction::ENCODE;
+    if (p.type == Type::BLOWFISH)
+        prepared.blowfish_key = blowfish::load_key(p.blowfish_key);
+    if (p.type == Type::RSA && encode)
+        prepared.rsa_public_key = rsa::load_key(p.rsa_modulus, p.rsa_public_exponent);
+    if (p.type == Type::RSA && decode)
+        prepared.rsa_private_key = rsa::load_key(p.rsa_modulus, p.rsa_private_exponent);
+
+    return prepared;
+}
+
+// `output` holds the header, `body_size` encoded bytes with CRC-32 `body_checksum` and the tail, in that order
+void write_header_and_tail(std::span<unsigned char> output,
+                           size_t body_size,
+                           uint32_t body_checksum,
+                           const Prepared &p,
+                           stats::Recorder &stats)
+{
+    {
+        auto timer = stats.time(stats::Stage::COPY);
+        std::copy(p.header.begin(), p.header.end(), output.begin());
+        std::copy(p.tail.begin(), p.tail.end(), output.begin() + p.header_size + body_size);
+    }
+
+    if (p.tail_has_checksum)
+    {
+        auto timer = stats.time(stats::Stage::CHECKSUM);
+        uint32_t crc = zlib_utils::checksum_combine(zlib_utils::checksum(output.first(p.header_size)), body_checksum, body_size);
+        std::memcpy(output.data() + p.header_size + body_size + layout::TAIL_CRC32_OFFSET, &crc, sizeof(crc));
+    }
+}
+
+// length-preserving transforms of every type except l2encdec::Type::RSA; `input` and `output` may alias.
+// A non-null `checksum` receives the CRC-32 of the encoded side, `output` when encrypting and `input` when decrypting,
+// computed slice by slice right after or before each slice is transformed.
+void transform_body(std::span<const unsigned char> input,
+                    std::span<unsigned char> output,
+                    const Prepared &p,
+                    bool encrypt,
+                    uint32_t *checksum,
+                    stats::Recorder &stats)
+{
+    using l2encdec::Type;
+
+    auto transform = [&](std::span<const unsigned char> in, std::span<unsigned char> out, size_t offset)
+    {
+        switch (p.type)
+        {
+        case Type::XOR:
+        case Type::XOR_FILENAME:
+            xor_utils::apply(in, out, p.xor_key);
+            break;
+        case Type::XOR_POSITION:
+            xor_utils::apply_position(in, out, p.xor_start_position + static_cast<int>(offset % XOR_KEYSTREAM_PERIOD));
+            break;
+        case Type::BLOWFISH:
+            if (encrypt)
+                blowfish::encrypt(in, out, *p.blowfish_key);
+            else
+                blowfish::decrypt(in, out, *p.blowfish_key);
+            break;
+        default:
+            if (in.data() != out.data())
+                std::copy(in.begin(), in.end(), out.begin());
+            break;
+        }
+    };
+
+    size_t slices = (input.size() + BODY_SLICE_SIZE - 1) / BODY_SLICE_SIZE;
+    std::vector<uint32_t> checksums(checksum ? slices : 0);
+    thread_pool::parallel_for(slices, BODY_SLICES_PER_TASK, [&](size_t begin, size_t end)
+                              {
+        for (size_t i = begin; i < end; ++i)
+        {
+            size_t offset = i * BODY_SLICE_SIZE;
+            size_t size = std::min(BODY_SLICE_SIZE, input.size() - offset);
+            auto in = input.subspan(offset, size);
+            auto out = output.subspan(offset, size);
+            // decrypting may overwrite its input, so the encoded bytes are checksummed first
+            if (checksum && !encrypt)
+            {
+                auto timer = stats.time(stats::Stage::CHECKSUM);
+                checksums[i] = zlib_utils::checksum(in);
+            }
+            {
+                auto timer = stats.time(stats::Stage::TRANSFORM);
+                transform(in, out, offset);
+            }
+            if (checksum && encrypt)
+            {
+                auto timer = stats.time(stats::Stage::CHECKSUM);
+                checksums[i] = zlib_utils::checksum(out);
+            }
+        } });
+
+    if (!checksum)
+        return;
+
+    auto timer = stats.time(stats::Stage::CHECKSUM);
+    *checksum = 0;
+    for (size_t i = 0; i < slices; ++i)
+        *checksum = zlib_utils::checksum_combine(*checksum, checksums[i], std::min(BODY_SLICE_SIZE, input.size() - i * BODY_SLICE_SIZE));
+}
+
+// CRC-32 stored in the tail of `input`, which must be at least layout::TAIL_SIZE bytes
+uint32_t stored_checksum(std::span<const unsigned char> input)
+{
+    uint32_t checksum;
+    std::memcpy(
+        &checksum,
+        input.data() + input.size() - layout::TAIL_SIZE + layout::TAIL_CRC32_OFFSET,
+        sizeof(uint32_t));
+    return checksum;
+}
+
+// same as l2encdec::verify_checksum, reusing the CRC-32 of `payload`, a sub-range of `input`
+l2encdec::ChecksumResult verify_with_payload(std::span<const unsigned char> input,
+                                             std::span<const unsigned char> payload,
+                                             uint32_t payload_checksum)
+{
+    using l2encdec::ChecksumResult;
+
+    if (input.size() < layout::TAIL_SIZE)
+        return ChecksumResult::MISMATCH;
+
+    size_t checked = input.size() - layout::TAIL_SIZE;
+    size_t payload_begin = payload.data() - input.data();
+    size_t payload_end = payload_begin + payload.size();
+    // a custom tail shorter than the default one leaves the payload reaching into the checksummed range's end
+    if (payload_end > checked)
+        return l2encdec::verify_checksum(std::as_bytes(input));
+
+    uint32_t crc = zlib_utils::checksum(input.first(payload_begin));
+    crc = zlib_utils::checksum_combine(crc, payload_checksum, payload.size());
+    crc = zlib_utils::checksum(input.subspan(payload_end, checked - payload_end), crc);
+    return crc == stored_checksum(input) ? ChecksumResult::SUCCESS : ChecksumResult::MISMATCH;
+}
+
+l2encdec::EncodeResult encode_into(std::span<const unsigned char> input,
+                                   const Prepared &p,
+                                   const Allocate &allocate,
+                                   stats::Recorder &stats)
+{
+    using l2encdec::EncodeResult;
+    using l2encdec::Type;
+
+    if (!p.valid_header)
+        return EncodeResult::INVALID_TYPE;
+
+    memory::Scratch encrypted(p.memory_resource);
+    size_t body_size = input.size();
+    if (p.type == Type::RSA)
+    {
+        if (!p.rsa_public_key)
+            return EncodeResult::ENCRYPTION_FAILED;
+        if (auto result = pipeline::encode(input, p.compression_level, *p.rsa_public_key, encrypted, stats); result != EncodeResult::SUCCESS)
+            return result;
+        body_size = encrypted.size();
+    }
+
+    size_t total_size = p.header_size + body_size + p.tail.size();
+    std::span<unsigned char> output = allocate(total_size);
+    if (output.size() != total_size)
+        return EncodeResult::BUFFER_TOO_SMALL;
+
+    std::span<unsigned char> body = output.subspan(p.header_size, body_size);
+    uint32_t body_checksum = 0;
+    if (p.type != Type::RSA)
+        transform_body(input, body, p, true, p.tail_has_checksum ? &body_checksum : nullptr, stats);
+    else
+    {
+        {
+            auto timer = stats.time(stats::Stage::COPY);
+            std::copy(encrypted.data(), encrypted.data() + encrypted.size(), body.begin());
+        }
+        if (p.tail_has_checksum)
+        {
+            auto timer = stats.time(stats::Stage::CHECKSUM);
+            body_checksum = zlib_utils::checksum(body);
+        }
+    }
+
+    write_header_and_tail(output, body_size, body_checksum, p, stats);
+    stats.add_bytes(input.size(), total_size);
+    return EncodeResult::SUCCESS;
+}
+
+l2encdec::DecodeResult payload_of(std::span<const unsigned char> input, const Prepared &p, std::span<const unsigned char> &payload)
+{
+    if (input.size() < p.header_size + p.decode_tail_size)
+        return l2encdec::DecodeResult::INVALID_TYPE;
+
+    payload = input.subspan(p.header_size, input.size() - p.header_size - p.decode_tail_size);
+    return l2encdec::DecodeResult::SUCCESS;
+}
+
+// the uncompressed size leads the zlib stream, so only the first block needs decrypting
+l2encdec::DecodeResult rsa_unpacked_size(std::span<const unsigned char> data,
+                                         const rsa::Key &key,
+                                         size_t &size,
+                                         stats::Recorder &stats = stats::Recorder::disabled())
+{
+    using l2encdec::DecodeResult;
+
+    std::vector<unsigned char> first_block;
+    {
+        auto timer = stats.time(stats::Stage::RSA);
+        if (rsa::decrypt(data.first(std::min(data.size(), rsa::BLOCK_SIZE)), first_block, key) != 0)
+            return DecodeResult::DECRYPTION_FAILED;
+    }
+    stats.add_rsa_blocks(1);
+
+    // padding makes the payload an upper bound of the packed size
+    if (zlib_utils::unpacked_size(first_block, data.size(), size) != 0)
+        return DecodeResult::DECOMPRESSION_FAILED;
+
+    return DecodeResult::SUCCESS;
+}
+
+// a non-null `checksum` receives the result of l2encdec::verify_checksum on success
+l2encdec::DecodeResult decode_into(std::span<const unsigned char> input,
+                                   const Prepared &p,
+                                   const Allocate &allocate,
+                                   stats::Recorder &stats,
+                                   l2encdec::ChecksumResult *checksum = nullptr)
+{
+    using l2encdec::DecodeResult;
+    using l2encdec::Type;
+
+    std::span<const unsigned char> data;
+    if (auto result = payload_of(input, p, data); result != DecodeResult::SUCCESS)
+        return result;
+
+    if (p.type == Type::RSA)
+    {
+        if (!p.rsa_private_key)
+            return DecodeResult::DECRYPTION_FAILED;
+        const rsa::Key &key = *p.rsa_private_key;
+
+        size_t size = 0;
+        if (auto result = rsa_unpacked_size(data, key, size, stats); result != DecodeResult::SUCCESS)
+            return result;
+
+        std::span<unsigned char> output = allocate(size);
+        if (output.size() != size)
+            return DecodeResult::BUFFER_TOO_SMALL;
+
+        // decryption dominates, so the input gets its own checksum pass
+        auto result = pipeline::decode(data, key, output, p.memory_resource, stats);
+        if (result == DecodeResult::SUCCESS && checksum)
+        {
+            auto timer = stats.time(stats::Stage::CHECKSUM);
+            *checksum = l2encdec::verify_checksum(std::as_bytes(input));
+        }
+        if (result == DecodeResult::SUCCESS)
+            stats.add_bytes(input.size(), size);
+        return result;
+    }
+
+    std::span<unsigned char> output = allocate(data.size());
+    if (output.size() != data.size())
+        return DecodeResult::BUFFER_TOO_SMALL;
+
+    uint32_t payload_checksum = 0;
+    transform_body(data, output, p, false, checksum ? &payload_checksum : nullptr, stats);
+    if (checksum)
+    {
+        auto timer = stats.time(stats::Stage::CHECKSUM);
+        *checksum = verify_with_payload(input, data, payload_checksum);
+    }
+    stats.add_bytes(input.size(), data.size());
+    return DecodeResult::SUCCESS;
+}
+
+Allocate allocate_in(std::vector<unsigned char> &buffer, stats::Recorder &stats)
+{
+    return [&buffer, &stats](size_t size)
+    {
+        stats.allocated(size);
+        buffer.resize(size);
+        return std::span<unsigned char>(buffer);
+    };
+}
+
+Allocate allocate_in(std::span<unsigned char> buffer, size_t &required)
+{
+    return [buffer, &required](size_t size)
+    {
+        required = size;
+        return size <= buffer.size() ? buffer.first(size) : std::span<unsigned char>();
+    };
+}
+
+l2encdec::EncodeResult prepared_encode(const std::vector<unsigned char> &input,
+                                       std::vector<unsigned char> &output,
+                                       const Prepared &p)
+{
+    stats::Recorder stats(p.stats);
+    std::vector<unsigned char> enc;
+    auto result = encode_into(input, p, allocate_in(enc, stats), stats);
+    if (result == l2encdec::EncodeResult::SUCCESS)
+        output = std::move(enc);
+
+    return result;
+}
+
+size_t prepared_encoded_size_bound(size_t input_size, const Prepared &p)
+{
+    size_t body_size = p.type == l2encdec::Type::RSA
+                           ? rsa::padded_size(zlib_utils::pack_bound(input_size))
+                           : input_size;
+    return p.header_size + body_size + p.tail.size();
+}
+
+l2encdec::EncodeResult prepared_encode(std::span<const std::byte> input,
+                                       std::span<std::byte> output,
+                                       size_t &written,
+                                       const Prepared &p)
+{
+    using l2encdec::EncodeResult;
+
+    stats::Recorder stats(p.stats);
+    size_t required = 0;
+    auto result = encode_into(as_uchars(input), p, allocate_in(as_uchars(output), required), stats);
+    written = result == EncodeResult::SUCCESS || result == EncodeResult::BUFFER_TOO_SMALL ? required : 0;
+    return result;
+}
+
+l2encdec::EncodeResult prepared_encode_inplace(std::span<std::byte> data,
+                                               size_t input_size,
+                                               size_t &written,
+                                               const Prepared &p)
+{
+    using l2encdec::EncodeResult;
+
+    written = 0;
+    if (p.type == l2encdec::Type::RSA || !p.valid_header || input_size > data.size())
+        return EncodeResult::INVALID_TYPE;
+
+    auto buffer = as_uchars(data);
+    size_t header_end = p.header_size;
+    size_t total_size = header_end + input_size + p.tail.size();
+    if (total_size > buffer.size())
+    {
+        written = total_size;
+        return EncodeResult::BUFFER_TOO_SMALL;
+    }
+
+    stats::Recorder stats(p.stats);
+    {
+        auto timer = stats.time(stats::Stage::COPY);
+        std::memmove(buffer.data() + header_end, buffer.data(), input_size);
+    }
+    auto body = buffer.subspan(header_end, input_size);
+    uint32_t body_checksum = 0;
+    transform_body(body, body, p, true, p.tail_has_checksum ? &body_checksum : nullptr, stats);
+    write_header_and_tail(buffer.first(total_size), input_size, body_checksum, p, stats);
+    stats.add_bytes(input_size, total_size);
+
+    written = total_size;
+    return EncodeResult::SUCCESS;
+}
+
+l2encdec::DecodeResult prepared_decode(const std::vector<unsigned char> &input,
+                                       std::vector<unsigned char> &output,
+                                       const Prepared &p)
+{
+    stats::Recorder stats(p.stats);
+    std::vector<unsigned char> dec;
+    auto result = decode_into(input, p, allocate_in(dec, stats), stats);
+    if (result == l2encdec::DecodeResult::SUCCESS)
+        output = std::move(dec);
+
+    return result;
+}
+
+l2encdec::DecodeResult prepared_decode_inplace(std::span<std::byte> data,
+                                               std::span<std::byte> &payload,
+                                               const Prepared &p)
+{
+    using l2encdec::DecodeResult;
+
+    if (p.type == l2encdec::Type::RSA)
+        return DecodeResult::INVALID_TYPE;
+
+    std::span<const unsigned char> body;
+    if (auto result = payload_of(as_uchars(data), p, body); result != DecodeResult::SUCCESS)
+        return result;
+
+    stats::Recorder stats(p.stats);
+    payload = data.subspan(body.data() - as_uchars(data).data(), body.size());
+    transform_body(body, as_uchars(payload), p, false, nullptr, stats);
+    stats.add_bytes(data.size(), body.size());
+    return DecodeResult::SUCCESS;
+}
+
+l2encdec::DecodeResult prepared_decoded_size(std::span<const std::byte> input, size_t &size, const Prepared &p)
+{
+    using l2encdec::DecodeResult;
+
+    std::span<const unsigned char> data;
+    if (auto result = payload_of(as_uchars(input), p, data); result != DecodeResult::SUCCESS)
+        return result;
+
+    if (p.type != l2encdec::Type::RSA)
+    {
+        size = data.size();
+        return DecodeResult::SUCCESS;
+    }
+
+    if (!p.rsa_private_key)
+        return DecodeResult::DECRYPTION_FAILED;
+
+    return rsa_unpacked_size(data, *p.rsa_private_key, size);
+}
+
+// a non-null `checksum` is set to MISMATCH unless decoding succeeds and the checksum matches
+l2encdec::DecodeResult prepared_decode(std::span<const std::byte> input,
+                                       std::span<std::byte> output,
+                                       size_t &written,
+                                       l2encdec::ChecksumResult *checksum,
+                                       const Prepared &p)
+{
+    using l2encdec::DecodeResult;
+
+    stats::Recorder stats(p.stats);
+    size_t required = 0;
+    if (checksum)
+        *checksum = l2encdec::ChecksumResult::MISMATCH;
+    auto result = decode_into(as_uchars(input), p, allocate_in(as_uchars(output), required), stats, checksum);
+    written = result == DecodeResult::SUCCESS || result == DecodeResult::BUFFER_TOO_SMALL ? required : 0;
+    return result;
+}
+
+// codec for the protocol overloads, each built on its first use; null for 121, whose key depends on the filename
+const l2encdec::Codec *protocol_codec(int protocol, bool use_legacy_decrypt_rsa)
+{
+    const ProtocolConfig *config = find_protocol(protocol);
+    if (!config || config->type == l2encdec::Type::XOR_FILENAME)
+        return nullptr;
+
+    static std::once_flag built[std::size(PROTOCOL_CONFIGS)][2];
+    static std::optional<l2encdec::Codec> codecs[std::size(PROTOCOL_CONFIGS)][2];
+    size_t index = config - PROTOCOL_CONFIGS;
+    bool legacy = use_legacy_decrypt_rsa && config->type == l2encdec::Type::RSA;
+    std::call_once(built[index][legacy], [&]()
+                   { codecs[index][legacy].emplace(protocol, "", legacy); });
+    return &*codecs[index][legacy];
+}
 } // namespace
 
 L2ENCDEC_API bool l2encdec::init_params(
@@ -45,33 +620,52 @@ L2ENCDEC_API bool l2encdec::init_params(
     if (protocol == 121 && filename.empty())
         return false;
 
-    auto it = PROTOCOL_CONFIGS.find(protocol);
-    if (it == PROTOCOL_CONFIGS.end())
+    const ProtocolConfig *config = find_protocol(protocol);
+    if (!config)
         return false;
 
-    params = it->second;
-    if (params.type == Type::RSA && !use_legacy_decrypt_rsa)
-        params = MODERN_RSA_PARAMS;
+    if (config->type == Type::RSA && !use_legacy_decrypt_rsa)
+        config = &MODERN_RSA_CONFIG;
 
-    params.protocol = protocol;
-    params.filename = filename;
+    params = Params{
+        .type = config->type,
+        .protocol = protocol,
+        .header = {},
+        .tail = {},
+        .filename = filename,
+        .xor_key = config->xor_key,
+        .xor_start_position = config->xor_start_position,
+        .blowfish_key = std::string(config->blowfish_key),
+        .rsa_modulus = std::string(config->rsa_modulus),
+        .rsa_public_exponent = std::string(config->rsa_public_exponent),
+        .rsa_private_exponent = std::string(config->rsa_private_exponent),
+    };
 
     return true;
 }
 
+L2ENCDEC_API void l2encdec::set_max_threads(size_t count)
+{
+    thread_pool::set_max_threads(count);
+}
+
+L2ENCDEC_API std::pmr::memory_resource *l2encdec::huge_page_resource()
+{
+    return memory::huge_page_resource();
+}
+
 L2ENCDEC_API l2encdec::ChecksumResult l2encdec::verify_checksum(const std::vector<unsigned char> &input)
 {
-    if (input.size() < TAIL_SIZE)
-        return ChecksumResult::MISMATCH;
+    return verify_checksum(std::as_bytes(std::span(input)));
+}
 
-    uint32_t checksum;
-    std::memcpy(
-        &checksum,
-        input.data() + input.size() - TAIL_SIZE + TAIL_CRC32_OFFSET,
-        sizeof(uint32_t));
+L2ENCDEC_API l2encdec::ChecksumResult l2encdec::verify_checksum(std::span<const std::byte> input_data)
+{
+    auto input = as_uchars(input_data);
+    if (input.size() < layout::TAIL_SIZE)
+        return ChecksumResult::MISMATCH;
 
-    std::vector<unsigned char> notail(input.begin(), input.end() - TAIL_SIZE);
-    return zlib_utils::checksum(notail) == checksum
+    return zlib_utils::checksum(input.first(input.size() - layout::TAIL_SIZE)) == stored_checksum(input)
                ? ChecksumResult::SUCCESS
                : ChecksumResult::MISMATCH;
 }
@@ -81,56 +675,98 @@ L2ENCDEC_API l2encdec::EncodeResult l2encdec::encode(
     std::vector<unsigned char> &output,
     const Params &p)
 {
-    if (!p.skip_header && p.header.empty() && (p.protocol <= 99 || p.protocol > 999))
+    return prepared_encode(input, output, prepare(p, Direction::ENCODE));
+}
+
+L2ENCDEC_API size_t l2encdec::encoded_size_bound(size_t input_size, const Params &p)
+{
+    size_t body_size = p.type == Type::RSA
+                           ? rsa::padded_size(zlib_utils::pack_bound(input_size))
+                           : input_size;
+    return header_size(p) + body_size + encode_tail_size(p);
+}
+
+L2ENCDEC_API l2encdec::EncodeResult l2encdec::encode(
+    std::span<const std::byte> input,
+    std::span<std::byte> output,
+    size_t &written,
+    const Params &p)
+{
+    return prepared_encode(input, output, written, prepare(p, Direction::ENCODE));
+}
+
+L2ENCDEC_API l2encdec::EncodeResult l2encdec::encode_inplace(
+    std::span<std::byte> data,
+    size_t input_size,
+    size_t &written,
+    const Params &p)
+{
+    return prepared_encode_inplace(data, input_size, written, prepare(p, Direction::ENCODE));
+}
+
+L2ENCDEC_API l2encdec::EncodeResult l2encdec::encode_batch(
+    const std::vector<std::vector<unsigned char>> &inputs,
+    std::vector<std::vector<unsigned char>> &outputs,
+    const Params &params)
+{
+    Prepared p = prepare(params, Direction::ENCODE);
+    if (p.type != Type::RSA)
+    {
+        std::vector<std::vector<unsigned char>> encoded(inputs.size());
+        for (size_t i = 0; i < inputs.size(); ++i)
+            if (auto result = prepared_encode(inputs[i], encoded[i], p); result != EncodeResult::SUCCESS)
+                return result;
+
+        outputs = std::move(encoded);
+        return EncodeResult::SUCCESS;
+    }
+
+    if (!p.valid_header)
         return EncodeResult::INVALID_TYPE;
 
-    std::vector<unsigned char> enc;
-    switch (p.type)
-    {
-    case Type::XOR:
-        xor_utils::apply(input, enc, p.xor_key);
-        break;
-    case Type::XOR_FILENAME:
-        xor_utils::apply(input, enc, xor_utils::get_key_by_filename(p.filename));
-        break;
-    case Type::XOR_POSITION:
-        xor_utils::apply(input, enc, p.xor_start_position, xor_utils::get_key_by_index);
-        break;
-    case Type::BLOWFISH:
-        blowfish::encrypt(input, enc, p.blowfish_key);
-        break;
-    case Type::RSA:
-    {
-        std::vector<unsigned char> compressed;
-        if (zlib_utils::pack(input, compressed) != 0)
-            return EncodeResult::COMPRESSION_FAILED;
-        if (rsa::encrypt(compressed, enc, p.rsa_modulus, p.rsa_public_exponent) != 0)
+    if (!p.rsa_public_key)
+        return EncodeResult::ENCRYPTION_FAILED;
+    stats::Recorder stats(p.stats);
+    std::vector<std::vector<unsigned char>> compressed(inputs.size());
+    std::atomic<bool> compression_failed(false);
+    thread_pool::parallel_for(inputs.size(), 1, [&](size_t begin, size_t end)
+                              {
+        for (size_t i = begin; i < end; ++i)
+        {
+            auto timer = stats.time(stats::Stage::DEFLATE);
+            if (zlib_utils::pack(inputs[i], compressed[i], p.compression_level) != 0)
+                compression_failed = true;
+        } });
+    if (compression_failed)
+        return EncodeResult::COMPRESSION_FAILED;
+
+    std::vector<std::vector<unsigned char>> encrypted;
+    {
+        auto timer = stats.time(stats::Stage::RSA);
+        if (rsa::encrypt_batch(compressed, encrypted, *p.rsa_public_key) != 0)
             return EncodeResult::ENCRYPTION_FAILED;
-        break;
-    }
-    default:
-        enc = input;
-        break;
     }
 
-    if (!p.skip_header)
-        utils::add_header(
-            enc,
-            !p.header.empty()
-                ? p.header
-                : std::string(HEADER_PREFIX) + std::to_string(p.protocol));
+    std::vector<std::vector<unsigned char>> encoded(inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        encoded[i].resize(p.header_size + encrypted[i].size() + p.tail.size());
+        stats.allocated(encoded[i].size());
+        {
+            auto timer = stats.time(stats::Stage::COPY);
+            std::copy(encrypted[i].begin(), encrypted[i].end(), encoded[i].begin() + p.header_size);
+        }
+        uint32_t body_checksum;
+        {
+            auto timer = stats.time(stats::Stage::CHECKSUM);
+            body_checksum = zlib_utils::checksum(encrypted[i]);
+        }
+        write_header_and_tail(encoded[i], encrypted[i].size(), body_checksum, p, stats);
+        stats.add_rsa_blocks(encrypted[i].size() / rsa::BLOCK_SIZE);
+        stats.add_bytes(inputs[i].size(), encoded[i].size());
+    }
 
-    if (!p.skip_tail)
-        utils::add_tail(
-            enc,
-            !p.tail.empty()
-                ? p.tail
-                : utils::make_tail(
-                      zlib_utils::checksum(enc),
-                      TAIL_CRC32_OFFSET,
-                      TAIL_SIZE));
-
-    output = std::move(enc);
+    outputs = std::move(encoded);
     return EncodeResult::SUCCESS;
 }
 
@@ -139,45 +775,46 @@ L2ENCDEC_API l2encdec::DecodeResult l2encdec::decode(
     std::vector<unsigned char> &output,
     const Params &p)
 {
-    size_t header_size = p.skip_header ? 0 : !p.header.empty() ? p.header.size() * 2
-                                                               : HEADER_SIZE;
-    size_t tail_size = p.skip_tail ? 0 : !p.tail.empty() ? p.tail.size() / 2
-                                                         : TAIL_SIZE;
-    if (input.size() < header_size + tail_size)
+    return prepared_decode(input, output, prepare(p, Direction::DECODE));
+}
+
+L2ENCDEC_API l2encdec::DecodeResult l2encdec::decode_inplace(
+    std::span<std::byte> data,
+    std::span<std::byte> &payload,
+    const Params &p)
+{
+    // RSA is rejected before its key is loaded
+    if (p.type == Type::RSA)
         return DecodeResult::INVALID_TYPE;
 
-    std::vector<unsigned char> data(input.begin() + header_size, input.end() - tail_size);
-    std::vector<unsigned char> dec;
-    switch (p.type)
-    {
-    case Type::XOR:
-        xor_utils::apply(data, dec, p.xor_key);
-        break;
-    case Type::XOR_POSITION:
-        xor_utils::apply(data, dec, p.xor_start_position, xor_utils::get_key_by_index);
-        break;
-    case Type::XOR_FILENAME:
-        xor_utils::apply(data, dec, xor_utils::get_key_by_filename(p.filename));
-        break;
-    case Type::BLOWFISH:
-        blowfish::decrypt(data, dec, p.blowfish_key);
-        break;
-    case Type::RSA:
-    {
-        std::vector<unsigned char> compressed;
-        if (rsa::decrypt(data, compressed, p.rsa_modulus, p.rsa_private_exponent) != 0)
-            return DecodeResult::DECRYPTION_FAILED;
-        if (zlib_utils::unpack(compressed, dec) != 0)
-            return DecodeResult::DECOMPRESSION_FAILED;
-        break;
-    }
-    default:
-        dec = std::move(data);
-        break;
-    }
+    return prepared_decode_inplace(data, payload, prepare(p, Direction::DECODE));
+}
 
-    output = std::move(dec);
-    return DecodeResult::SUCCESS;
+L2ENCDEC_API l2encdec::DecodeResult l2encdec::decoded_size(
+    std::span<const std::byte> input,
+    size_t &size,
+    const Params &p)
+{
+    return prepared_decoded_size(input, size, prepare(p, Direction::DECODE));
+}
+
+L2ENCDEC_API l2encdec::DecodeResult l2encdec::decode(
+    std::span<const std::byte> input,
+    std::span<std::byte> output,
+    size_t &written,
+    const Params &p)
+{
+    return prepared_decode(input, output, written, nullptr, prepare(p, Direction::DECODE));
+}
+
+L2ENCDEC_API l2encdec::DecodeResult l2encdec::decode(
+    std::span<const std::byte> input,
+    std::span<std::byte> output,
+    size_t &written,
+    ChecksumResult &checksum,
+    const Params &p)
+{
+    return prepared_decode(input, output, written, &checksum, prepare(p, Direction::DECODE));
 }
 
 L2ENCDEC_API l2encdec::EncodeResult l2encdec::encode(
@@ -187,6 +824,9 @@ L2ENCDEC_API l2encdec::EncodeResult l2encdec::encode(
     const std::string &filename,
     bool use_legacy_decrypt_rsa)
 {
+    if (auto codec = protocol_codec(protocol, use_legacy_decrypt_rsa))
+        return codec->encode(input, output);
+
     l2encdec::Params p{};
     if (!l2encdec::init_params(p, protocol, filename, use_legacy_decrypt_rsa))
         return EncodeResult::INVALID_TYPE;
@@ -201,9 +841,142 @@ L2ENCDEC_API l2encdec::DecodeResult l2encdec::decode(
     const std::string &filename,
     bool use_legacy_decrypt_rsa)
 {
+    if (auto codec = protocol_codec(protocol, use_legacy_decrypt_rsa))
+        return codec->decode(input, output);
+
     l2encdec::Params p{};
     if (!l2encdec::init_params(p, protocol, filename, use_legacy_decrypt_rsa))
         return DecodeResult::INVALID_TYPE;
 
     return l2encdec::decode(input, output, p);
 }
+
+struct l2encdec::Codec::State
+{
+    bool valid;
+    Params params;
+    Prepared prepared;
+};
+
+L2ENCDEC_API l2encdec::Codec::Codec(const Params &params)
+    : state_(std::make_shared<const State>(State{
+          .valid = true,
+          .params = params,
+          .prepared = prepare(params, Direction::BOTH),
+      }))
+{
+}
+
+L2ENCDEC_API l2encdec::Codec::Codec(int protocol, const std::string &filename, bool use_legacy_decrypt_rsa)
+{
+    Params params{};
+    bool valid = init_params(params, protocol, filename, use_legacy_decrypt_rsa);
+    state_ = std::make_shared<const State>(State{
+        .valid = valid,
+        .params = params,
+        .prepared = prepare(params, Direction::BOTH),
+    });
+}
+
+L2ENCDEC_API bool l2encdec::Codec::is_valid() const
+{
+    return state_->valid;
+}
+
+L2ENCDEC_API const l2encdec::Params &l2encdec::Codec::params() const
+{
+    return state_->params;
+}
+
+L2ENCDEC_API l2encdec::EncodeResult l2encdec::Codec::encode(
+    const std::vector<unsigned char> &input,
+    std::vector<unsigned char> &output) const
+{
+    if (!state_->valid)
+        return EncodeResult::INVALID_TYPE;
+
+    return prepared_encode(input, output, state_->prepared);
+}
+
+L2ENCDEC_API size_t l2encdec::Codec::encoded_size_bound(size_t input_size) const
+{
+    return prepared_encoded_size_bound(input_size, state_->prepared);
+}
+
+L2ENCDEC_API l2encdec::EncodeResult l2encdec::Codec::encode(
+    std::span<const std::byte> input,
+    std::span<std::byte> output,
+    size_t &written) const
+{
+    written = 0;
+    if (!state_->valid)
+        return EncodeResult::INVALID_TYPE;
+
+    return prepared_encode(input, output, written, state_->prepared);
+}
+
+L2ENCDEC_API l2encdec::EncodeResult l2encdec::Codec::encode_inplace(
+    std::span<std::byte> data,
+    size_t input_size,
+    size_t &written) const
+{
+    written = 0;
+    if (!state_->valid)
+        return EncodeResult::INVALID_TYPE;
+
+    return prepared_encode_inplace(data, input_size, written, state_->prepared);
+}
+
+L2ENCDEC_API l2encdec::DecodeResult l2encdec::Codec::decode(
+    const std::vector<unsigned char> &input,
+    std::vector<unsigned char> &output) const
+{
+    if (!state_->valid)
+        return DecodeResult::INVALID_TYPE;
+
+    return prepared_decode(input, output, state_->prepared);
+}
+
+L2ENCDEC_API l2encdec::DecodeResult l2encdec::Codec::decoded_size(std::span<const std::byte> input, size_t &size) const
+{
+    if (!state_->valid)
+        return DecodeResult::INVALID_TYPE;
+
+    return prepared_decoded_size(input, size, state_->prepared);
+}
+
+L2ENCDEC_API l2encdec::DecodeResult l2encdec::Codec::decode(
+    std::span<const std::byte> input,
+    std::span<std::byte> output,
+    size_t &written) const
+{
+    written = 0;
+    if (!state_->valid)
+        return DecodeResult::INVALID_TYPE;
+
+    return prepared_decode(input, output, written, nullptr, state_->prepared);
+}
+
+L2ENCDEC_API l2encdec::DecodeResult l2encdec::Codec::decode(
+    std::span<const std::byte> input,
+    std::span<std::byte> output,
+    size_t &written,
+    ChecksumResult &checksum) const
+{
+    written = 0;
+    checksum = ChecksumResult::MISMATCH;
+    if (!state_->valid)
+        return DecodeResult::INVALID_TYPE;
+
+    return prepared_decode(input, output, written, &checksum, state_->prepared);
+}
+
+L2ENCDEC_API l2encdec::DecodeResult l2encdec::Codec::decode_inplace(
+    std::span<std::byte> data,
+    std::span<std::byte> &payload) const
+{
+    if (!state_->valid)
+        return DecodeResult::INVALID_TYPE;
+
+    return prepared_decode_inplace(data, payload, state_->prepared);
+}
@@ -0,0 +1,43 @@
+#include "layout.h"
+#include "utils.h"
+#include <string_view>
+
+namespace
+{
+constexpr std::string_view HEADER_PREFIX = "Lineage2Ver";
+constexpr size_t PROTOCOL_SIZE = 3;
+constexpr size_t HEADER_SIZE = (HEADER_PREFIX.size() + PROTOCOL_SIZE) * 2;
+} // namespace
+
+bool layout::has_valid_header(const l2encdec::Params &p)
+{
+    return p.skip_header || !p.header.empty() || (p.protocol > 99 && p.protocol <= 999);
+}
+
+size_t layout::header_size(const l2encdec::Params &p)
+{
+    return p.skip_header ? 0 : !p.header.empty() ? p.header.size() * 2
+                                                 : HEADER_SIZE;
+}
+
+size_t layout::decode_tail_size(const l2encdec::Params &p)
+{
+    return p.skip_tail ? 0 : !p.tail.empty() ? p.tail.size() / 2
+                                             : TAIL_SIZE;
+}
+
+size_t layout::encode_tail_size(const l2encdec::Params &p)
+{
+    return p.skip_tail ? 0 : !p.tail.empty() ? utils::tail_size(p.tail)
+                                             : TAIL_SIZE;
+}
+
+std::string layout::header(const l2encdec::Params &p)
+{
+    return !p.header.empty() ? p.header : std::string(HEADER_PREFIX) + std::to_string(p.protocol);
+}
+
+std::string layout::tail(const l2encdec::Params &p, uint32_t crc)
+{
+    return !p.tail.empty() ? p.tail : utils::make_tail(crc, TAIL_CRC32_OFFSET, TAIL_SIZE);
+}
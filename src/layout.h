@@ -0,0 +1,25 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <l2encdec.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// where the header, body and tail of an encoded file start, shared by the one-shot and streaming codecs
+namespace layout
+{
+constexpr size_t TAIL_SIZE = 20;
+constexpr size_t TAIL_CRC32_OFFSET = 12;
+
+bool has_valid_header(const l2encdec::Params &p);
+size_t header_size(const l2encdec::Params &p);
+size_t decode_tail_size(const l2encdec::Params &p);
+size_t encode_tail_size(const l2encdec::Params &p);
+// header text written as UTF-16LE in front of the body
+std::string header(const l2encdec::Params &p);
+// tail hex string, holding `crc` of everything before it unless a custom tail is set
+std::string tail(const l2encdec::Params &p, uint32_t crc);
+} // namespace layout
+
+#endif // LAYOUT_H
@@ -0,0 +1,116 @@
+#include "memory.h"
+#include <cstdint>
+#include <new>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+// size of a transparent huge page on x86-64 and the usual arm64 kernels
+constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+class HugePageResource final : public std::pmr::memory_resource
+{
+    static bool use_huge_pages(size_t bytes, size_t alignment)
+    {
+#ifdef MADV_HUGEPAGE
+        return bytes >= HUGE_PAGE_SIZE && alignment <= HUGE_PAGE_SIZE;
+#else
+        (void)bytes;
+        (void)alignment;
+        return false;
+#endif
+    }
+
+    static size_t round_up(size_t bytes)
+    {
+        return (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    }
+
+    void *do_allocate(size_t bytes, size_t alignment) override
+    {
+        if (!use_huge_pages(bytes, alignment))
+            return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+
+#ifdef MADV_HUGEPAGE
+        // the kernel only backs whole aligned huge pages, so map one extra and trim both ends to the boundary
+        size_t size = round_up(bytes);
+        void *mapped = mmap(nullptr, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED)
+            throw std::bad_alloc();
+
+        auto begin = reinterpret_cast<uintptr_t>(mapped);
+        uintptr_t aligned = (begin + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        if (aligned != begin)
+            munmap(mapped, aligned - begin);
+        if (size_t tail = begin + HUGE_PAGE_SIZE - aligned; tail != 0)
+            munmap(reinterpret_cast<void *>(aligned + size), tail);
+
+        madvise(reinterpret_cast<void *>(aligned), size, MADV_HUGEPAGE);
+        return reinterpret_cast<void *>(aligned);
+#else
+        return nullptr;
+#endif
+    }
+
+    void do_deallocate(void *p, size_t bytes, size_t alignment) override
+    {
+        if (!use_huge_pages(bytes, alignment))
+            return std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+
+#ifdef MADV_HUGEPAGE
+        munmap(p, round_up(bytes));
+#endif
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+} // namespace
+
+memory::Scratch::Scratch(std::pmr::memory_resource *resource)
+    : resource_(resource ? resource : std::pmr::get_default_resource())
+{
+}
+
+memory::Scratch::~Scratch()
+{
+    release();
+}
+
+void memory::Scratch::allocate(size_t size)
+{
+    release();
+    if (size == 0)
+        return;
+
+    data_ = static_cast<unsigned char *>(resource_->allocate(size, alignof(std::max_align_t)));
+    size_ = size;
+    capacity_ = size;
+}
+
+void memory::Scratch::shrink(size_t size)
+{
+    if (size < size_)
+        size_ = size;
+}
+
+void memory::Scratch::release()
+{
+    if (data_)
+        resource_->deallocate(data_, capacity_, alignof(std::max_align_t));
+    data_ = nullptr;
+    size_ = 0;
+    capacity_ = 0;
+}
+
+std::pmr::memory_resource *memory::huge_page_resource()
+{
+    // leaked so it outlives pools and callers still using it from static destructors or detached threads
+    static auto *resource = new HugePageResource;
+    return resource;
+}
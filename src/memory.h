@@ -0,0 +1,43 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <cstddef>
+#include <memory_resource>
+#include <span>
+
+namespace memory
+{
+// uninitialized bytes from a memory resource, for buffers whose bytes are all written before they are read
+class Scratch
+{
+public:
+    // a null `resource` uses std::pmr::get_default_resource()
+    explicit Scratch(std::pmr::memory_resource *resource);
+    ~Scratch();
+
+    Scratch(const Scratch &) = delete;
+    Scratch &operator=(const Scratch &) = delete;
+
+    // replaces the contents with `size` new bytes
+    void allocate(size_t size);
+    // drops the bytes past `size`, keeping the allocation
+    void shrink(size_t size);
+
+    unsigned char *data() const { return data_; }
+    size_t size() const { return size_; }
+    std::span<unsigned char> span() const { return {data_, size_}; }
+
+private:
+    void release();
+
+    std::pmr::memory_resource *resource_;
+    unsigned char *data_ = nullptr;
+    size_t size_ = 0;
+    size_t capacity_ = 0;
+};
+
+// see l2encdec::huge_page_resource
+std::pmr::memory_resource *huge_page_resource();
+} // namespace memory
+
+#endif // MEMORY_H
@@ -0,0 +1,245 @@
+#include "montgomery.h"
+#include <bit>
+#include <utility>
+
+#if !defined(__SIZEOF_INT128__) && defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+#include <intrin.h>
+#endif
+
+namespace
+{
+using montgomery::Context;
+using montgomery::LIMBS;
+
+using Row = std::make_index_sequence<LIMBS>;
+
+#if defined(__SIZEOF_INT128__)
+__extension__ typedef unsigned __int128 uint128_t;
+
+inline uint64_t mul_add(uint64_t a, uint64_t b, uint64_t c, uint64_t &carry)
+{
+    uint128_t p = static_cast<uint128_t>(a) * b + c + carry;
+    carry = static_cast<uint64_t>(p >> 64);
+    return static_cast<uint64_t>(p);
+}
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+inline uint64_t mul_add(uint64_t a, uint64_t b, uint64_t c, uint64_t &carry)
+{
+    uint64_t lo = a * b;
+    uint64_t hi = __umulh(a, b);
+    lo += c;
+    hi += lo < c;
+    lo += carry;
+    hi += lo < carry;
+    carry = hi;
+    return lo;
+}
+#else
+inline uint64_t mul_add(uint64_t a, uint64_t b, uint64_t c, uint64_t &carry)
+{
+    uint64_t a_lo = a & 0xFFFFFFFF, a_hi = a >> 32;
+    uint64_t b_lo = b & 0xFFFFFFFF, b_hi = b >> 32;
+    uint64_t ll = a_lo * b_lo;
+    uint64_t lh = a_lo * b_hi;
+    uint64_t hl = a_hi * b_lo;
+    uint64_t mid = (ll >> 32) + (lh & 0xFFFFFFFF) + (hl & 0xFFFFFFFF);
+    uint64_t lo = (mid << 32) | (ll & 0xFFFFFFFF);
+    uint64_t hi = a_hi * b_hi + (lh >> 32) + (hl >> 32) + (mid >> 32);
+    lo += c;
+    hi += lo < c;
+    lo += carry;
+    hi += lo < carry;
+    carry = hi;
+    return lo;
+}
+#endif
+
+// t[0..LIMBS) += a * b, returns the carry limb
+template <size_t... J>
+inline uint64_t mul_row(uint64_t *t, const uint64_t *a, uint64_t b, std::index_sequence<J...>)
+{
+    uint64_t carry = 0;
+    ((t[J] = mul_add(a[J], b, t[J], carry)), ...);
+    return carry;
+}
+
+template <size_t... I>
+inline void mul_wide(uint64_t *t, const uint64_t *a, const uint64_t *b, std::index_sequence<I...>)
+{
+    ((t[I + LIMBS] = mul_row(t + I, a, b[I], Row{})), ...);
+}
+
+template <size_t I, size_t... J>
+inline void sqr_cross_row(uint64_t *t, const uint64_t *a, std::index_sequence<J...>)
+{
+    uint64_t carry = 0;
+    ((t[2 * I + 1 + J] = mul_add(a[I], a[I + 1 + J], t[2 * I + 1 + J], carry)), ...);
+    t[I + LIMBS] = carry;
+}
+
+template <size_t... I>
+inline void sqr_wide(uint64_t *t, const uint64_t *a, std::index_sequence<I...>)
+{
+    (sqr_cross_row<I>(t, a, std::make_index_sequence<LIMBS - 1 - I>{}), ...);
+
+    uint64_t top = 0;
+    for (size_t i = 0; i < 2 * LIMBS; ++i)
+    {
+        uint64_t shifted = (t[i] << 1) | top;
+        top = t[i] >> 63;
+        t[i] = shifted;
+    }
+
+    uint64_t carry = 0;
+    for (size_t i = 0; i < LIMBS; ++i)
+    {
+        t[2 * i] = mul_add(a[i], a[i], t[2 * i], carry);
+        uint64_t sum = t[2 * i + 1] + carry;
+        carry = sum < carry;
+        t[2 * i + 1] = sum;
+    }
+}
+
+inline bool less(const uint64_t *a, const uint64_t *b)
+{
+    for (size_t i = LIMBS; i-- > 0;)
+        if (a[i] != b[i])
+            return a[i] < b[i];
+    return false;
+}
+
+inline void sub(uint64_t *a, const uint64_t *b)
+{
+    uint64_t borrow = 0;
+    for (size_t i = 0; i < LIMBS; ++i)
+    {
+        uint64_t diff = a[i] - b[i];
+        uint64_t next_borrow = a[i] < b[i];
+        next_borrow |= diff < borrow;
+        a[i] = diff - borrow;
+        borrow = next_borrow;
+    }
+}
+
+// r = t * R^-1 mod N; clobbers t
+inline void reduce(uint64_t *r, uint64_t *t, const Context &ctx)
+{
+    uint64_t extra = 0;
+    for (size_t i = 0; i < LIMBS; ++i)
+    {
+        uint64_t carry = mul_row(t + i, ctx.modulus, t[i] * ctx.n0_inv, Row{});
+        uint64_t sum = t[i + LIMBS] + carry;
+        uint64_t overflow = sum < carry;
+        sum += extra;
+        overflow += sum < extra;
+        t[i + LIMBS] = sum;
+        extra = overflow;
+    }
+
+    uint64_t *high = t + LIMBS;
+    if (extra || !less(high, ctx.modulus))
+        sub(high, ctx.modulus);
+
+    for (size_t i = 0; i < LIMBS; ++i)
+        r[i] = high[i];
+}
+
+inline void mont_mul(uint64_t *r, const uint64_t *a, const uint64_t *b, const Context &ctx)
+{
+    uint64_t t[2 * LIMBS] = {};
+    mul_wide(t, a, b, Row{});
+    reduce(r, t, ctx);
+}
+
+inline void mont_sqr(uint64_t *r, const uint64_t *a, const Context &ctx)
+{
+    uint64_t t[2 * LIMBS] = {};
+    sqr_wide(t, a, Row{});
+    reduce(r, t, ctx);
+}
+
+void load_be(uint64_t *limbs, const unsigned char *bytes)
+{
+    for (size_t i = 0; i < LIMBS; ++i)
+    {
+        const unsigned char *p = bytes + montgomery::BYTES - (i + 1) * sizeof(uint64_t);
+        uint64_t v = 0;
+        for (size_t b = 0; b < sizeof(uint64_t); ++b)
+            v = (v << 8) | p[b];
+        limbs[i] = v;
+    }
+}
+
+void store_be(unsigned char *bytes, const uint64_t *limbs)
+{
+    for (size_t i = 0; i < LIMBS; ++i)
+    {
+        unsigned char *p = bytes + montgomery::BYTES - (i + 1) * sizeof(uint64_t);
+        for (size_t b = 0; b < sizeof(uint64_t); ++b)
+            p[b] = static_cast<unsigned char>(limbs[i] >> (8 * (sizeof(uint64_t) - 1 - b)));
+    }
+}
+} // namespace
+
+bool montgomery::init(Context &ctx, const unsigned char *modulus, uint64_t exponent)
+{
+    load_be(ctx.modulus, modulus);
+
+    size_t top_bits = static_cast<size_t>(std::bit_width(ctx.modulus[LIMBS - 1]));
+    if (exponent == 0 || (ctx.modulus[0] & 1) == 0 || top_bits == 0 ||
+        (LIMBS - 1) * 64 + top_bits < MIN_MODULUS_BITS)
+        return false;
+
+    ctx.exponent = exponent;
+
+    uint64_t n0 = ctx.modulus[0];
+    uint64_t inv = n0;
+    for (int i = 0; i < 5; ++i)
+        inv *= 2 - n0 * inv;
+    ctx.n0_inv = 0 - inv;
+
+    uint64_t r[LIMBS] = {1};
+    for (size_t i = 0; i < 2 * LIMBS * 64; ++i)
+    {
+        uint64_t top = r[LIMBS - 1] >> 63;
+        for (size_t j = LIMBS - 1; j > 0; --j)
+            r[j] = (r[j] << 1) | (r[j - 1] >> 63);
+        r[0] <<= 1;
+        if (top || !less(r, ctx.modulus))
+            sub(r, ctx.modulus);
+    }
+
+    for (size_t i = 0; i < LIMBS; ++i)
+        ctx.r2[i] = r[i];
+
+    return true;
+}
+
+void montgomery::exp_mod(const Context &ctx, const unsigned char *input, unsigned char *output)
+{
+    uint64_t x[LIMBS];
+    load_be(x, input);
+    while (!less(x, ctx.modulus))
+        sub(x, ctx.modulus);
+
+    uint64_t base[LIMBS];
+    mont_mul(base, x, ctx.r2, ctx);
+
+    uint64_t acc[LIMBS];
+    for (size_t i = 0; i < LIMBS; ++i)
+        acc[i] = base[i];
+
+    for (int bit = static_cast<int>(std::bit_width(ctx.exponent)) - 2; bit >= 0; --bit)
+    {
+        mont_sqr(acc, acc, ctx);
+        if ((ctx.exponent >> bit) & 1)
+            mont_mul(acc, acc, base, ctx);
+    }
+
+    uint64_t t[2 * LIMBS] = {};
+    for (size_t i = 0; i < LIMBS; ++i)
+        t[i] = acc[i];
+    reduce(acc, t, ctx);
+
+    store_be(output, acc);
+}
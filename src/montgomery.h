@@ -0,0 +1,28 @@
+#ifndef MONTGOMERY_H
+#define MONTGOMERY_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace montgomery
+{
+constexpr size_t LIMBS = 16;
+constexpr size_t BYTES = LIMBS * sizeof(uint64_t);
+constexpr size_t MIN_MODULUS_BITS = 1020;
+constexpr size_t MAX_EXPONENT_BITS = 64;
+
+struct Context
+{
+    uint64_t modulus[LIMBS];
+    uint64_t r2[LIMBS];
+    uint64_t n0_inv;
+    uint64_t exponent;
+};
+
+// `modulus` is big-endian; fails unless it is odd and between MIN_MODULUS_BITS and 1024 bits, and `exponent` is not 0
+bool init(Context &ctx, const unsigned char *modulus, uint64_t exponent);
+// `input` and `output` are BYTES long, big-endian, and may alias
+void exp_mod(const Context &ctx, const unsigned char *input, unsigned char *output);
+} // namespace montgomery
+
+#endif // MONTGOMERY_H
@@ -0,0 +1,285 @@
+#include "pipeline.h"
+#include "thread_pool.h"
+#include "zlib_utils.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+
+namespace
+{
+using rsa::BLOCK_BODY_SIZE;
+using rsa::BLOCK_SIZE;
+
+// blocks passed from one stage to the other at a time
+constexpr size_t BLOCKS_PER_HANDOFF = 32;
+// smaller inputs run both stages one after the other on the calling thread
+constexpr size_t PIPELINE_THRESHOLD = 64 * 1024;
+
+size_t stage_count(size_t size)
+{
+    return size < PIPELINE_THRESHOLD ? 1 : thread_pool::concurrency();
+}
+} // namespace
+
+l2encdec::EncodeResult pipeline::encode(std::span<const unsigned char> input,
+                                        int level,
+                                        const rsa::Key &public_key,
+                                        memory::Scratch &blocks,
+                                        stats::Recorder &stats)
+{
+    using l2encdec::EncodeResult;
+
+    size_t capacity = rsa::padded_size(zlib_utils::pack_bound(input.size())) / BLOCK_SIZE;
+    blocks.allocate(capacity * BLOCK_SIZE);
+    stats.allocated(blocks.size());
+
+    std::mutex mutex;
+    std::condition_variable blocks_cv;
+    size_t packed_blocks = 0;
+    size_t claimed_blocks = 0;
+    bool packing_done = false;
+    bool packing_failed = false;
+    std::atomic<int> error(0);
+
+    auto publish = [&](size_t count)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            packed_blocks = count;
+        }
+        blocks_cv.notify_all();
+    };
+
+    size_t block = 0;
+    size_t filled = 0;
+    bool overflow = false;
+    zlib_utils::ChunkedPack packer(input, level, [&](std::span<const unsigned char> chunk)
+                                   {
+        while (!chunk.empty() && !overflow)
+        {
+            if (block == capacity)
+            {
+                overflow = true;
+                break;
+            }
+
+            size_t size = std::min(BLOCK_BODY_SIZE - filled, chunk.size());
+            std::memcpy(blocks.data() + block * BLOCK_SIZE + BLOCK_SIZE - BLOCK_BODY_SIZE + filled, chunk.data(), size);
+            filled += size;
+            chunk = chunk.subspan(size);
+
+            if (filled == BLOCK_BODY_SIZE)
+            {
+                rsa::seal_block(blocks.data() + block * BLOCK_SIZE, filled);
+                filled = 0;
+                if (++block % BLOCKS_PER_HANDOFF == 0)
+                    publish(block);
+            }
+        } });
+
+    // every thread compresses chunks first, the one to see the stream complete seals the last block
+    auto compress = [&]()
+    {
+        while (true)
+        {
+            auto timer = stats.time(stats::Stage::DEFLATE);
+            if (!packer.pack_next())
+                break;
+        }
+
+        if (!packer.finished())
+            return;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (packing_done)
+            return;
+
+        if (filled > 0 && !overflow)
+        {
+            rsa::seal_block(blocks.data() + block++ * BLOCK_SIZE, filled);
+            filled = 0;
+        }
+        packing_failed = packer.result() != 0 || overflow;
+        packed_blocks = block;
+        packing_done = true;
+        blocks_cv.notify_all();
+    };
+
+    auto encrypt = [&]()
+    {
+        while (true)
+        {
+            size_t begin, end;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                blocks_cv.wait(lock, [&]()
+                               { return packing_done || packed_blocks - claimed_blocks >= BLOCKS_PER_HANDOFF; });
+                if (claimed_blocks == packed_blocks)
+                    return;
+
+                begin = claimed_blocks;
+                end = std::min(packed_blocks, claimed_blocks + BLOCKS_PER_HANDOFF);
+                claimed_blocks = end;
+            }
+
+            if (error.load() != 0)
+                continue;
+
+            auto range = blocks.span().subspan(begin * BLOCK_SIZE, (end - begin) * BLOCK_SIZE);
+            auto timer = stats.time(stats::Stage::RSA);
+            if (int rc = rsa::exp_mod(range, range, public_key); rc != 0)
+            {
+                int expected = 0;
+                error.compare_exchange_strong(expected, rc);
+            }
+        }
+    };
+
+    thread_pool::parallel_for(stage_count(input.size()), 1, [&](size_t begin, size_t end)
+                              {
+        for (size_t stage = begin; stage < end; ++stage)
+        {
+            compress();
+            encrypt();
+        } });
+
+    if (packing_failed)
+        return EncodeResult::COMPRESSION_FAILED;
+    if (error.load() != 0)
+        return EncodeResult::ENCRYPTION_FAILED;
+
+    blocks.shrink(packed_blocks * BLOCK_SIZE);
+    stats.add_rsa_blocks(packed_blocks);
+    return EncodeResult::SUCCESS;
+}
+
+l2encdec::DecodeResult pipeline::decode(std::span<const unsigned char> blocks,
+                                        const rsa::Key &private_key,
+                                        std::span<unsigned char> output,
+                                        std::pmr::memory_resource *memory,
+                                        stats::Recorder &stats)
+{
+    using l2encdec::DecodeResult;
+
+    if (blocks.size() % BLOCK_SIZE != 0)
+        return DecodeResult::DECRYPTION_FAILED;
+
+    constexpr size_t HANDOFF_SIZE = BLOCKS_PER_HANDOFF * BLOCK_SIZE;
+    size_t handoffs = (blocks.size() + HANDOFF_SIZE - 1) / HANDOFF_SIZE;
+    memory::Scratch decrypted(memory);
+    decrypted.allocate(blocks.size());
+    stats.allocated(blocks.size());
+    stats.add_rsa_blocks(blocks.size() / BLOCK_SIZE);
+
+    std::mutex mutex;
+    std::condition_variable ready_cv;
+    // packed bytes left at the front of each decrypted handoff, valid once `ready`
+    std::vector<size_t> packed_sizes(handoffs);
+    std::vector<bool> ready(handoffs);
+    std::atomic<size_t> next_claim(0);
+    std::atomic<bool> stop(false);
+    std::atomic<int> error(0);
+
+    // decrypts the next unclaimed handoff, returns false once all are claimed
+    auto decrypt_next = [&]()
+    {
+        size_t handoff = next_claim.fetch_add(1);
+        if (handoff >= handoffs)
+            return false;
+
+        size_t offset = handoff * HANDOFF_SIZE;
+        auto range = std::span(decrypted.data() + offset, std::min(HANDOFF_SIZE, blocks.size() - offset));
+        size_t packed_size = 0;
+        if (!stop.load())
+        {
+            int rc;
+            {
+                auto timer = stats.time(stats::Stage::RSA);
+                rc = rsa::exp_mod(blocks.subspan(offset, range.size()), range, private_key);
+            }
+            if (rc != 0)
+            {
+                int expected = 0;
+                error.compare_exchange_strong(expected, rc);
+                stop = true;
+            }
+            else
+            {
+                auto timer = stats.time(stats::Stage::PADDING);
+                packed_size = rsa::remove_padding(range);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            packed_sizes[handoff] = packed_size;
+            ready[handoff] = true;
+        }
+        ready_cv.notify_all();
+        return true;
+    };
+
+    size_t next = 0;
+    auto next_handoff = [&]() -> std::span<const unsigned char>
+    {
+        if (next == handoffs || stop.load())
+            return {};
+
+        // decrypt the next handoff here rather than wait for a worker to claim it
+        while (next_claim.load() <= next && decrypt_next())
+        {
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        ready_cv.wait(lock, [&]()
+                      { return ready[next]; });
+        size_t handoff = next++;
+        return {decrypted.data() + handoff * HANDOFF_SIZE, packed_sizes[handoff]};
+    };
+
+    int inflate_rc = -1;
+    auto inflate = [&]()
+    {
+        if (!stats.enabled())
+        {
+            inflate_rc = zlib_utils::unpack(next_handoff, output);
+            stop = true;
+            return;
+        }
+
+        // handing over blocks includes decrypting and waiting for them, which is not inflate time
+        using clock = std::chrono::steady_clock;
+        auto start = clock::now();
+        std::chrono::nanoseconds handing_over{};
+        inflate_rc = zlib_utils::unpack([&]()
+                                        {
+            auto handoff_start = clock::now();
+            auto handoff = next_handoff();
+            handing_over += clock::now() - handoff_start;
+            return handoff; }, output);
+        stop = true;
+        stats.add_time(stats::Stage::INFLATE, clock::now() - start - handing_over);
+    };
+
+    thread_pool::parallel_for(stage_count(blocks.size()), 1, [&](size_t begin, size_t end)
+                              {
+        for (size_t stage = begin; stage < end; ++stage)
+        {
+            if (stage == 0)
+                inflate();
+            else
+                while (!stop.load() && decrypt_next())
+                {
+                }
+        } });
+
+    if (error.load() != 0)
+        return DecodeResult::DECRYPTION_FAILED;
+    if (inflate_rc != 0)
+        return DecodeResult::DECOMPRESSION_FAILED;
+
+    return DecodeResult::SUCCESS;
+}
@@ -0,0 +1,24 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "memory.h"
+#include "rsa.h"
+#include "stats.h"
+#include <l2encdec.h>
+#include <memory_resource>
+#include <span>
+
+// overlaps compression with RSA for l2encdec::Type::RSA, handing blocks between the stages as they complete
+namespace pipeline
+{
+// packs `input` straight into padded blocks, which are encrypted while deflate is still running
+l2encdec::EncodeResult encode(std::span<const unsigned char> input, int level, const rsa::Key &public_key, memory::Scratch &blocks,
+                              stats::Recorder &stats = stats::Recorder::disabled());
+// inflates blocks in order as they are decrypted; `output` must be exactly the unpacked size.
+// The decrypted blocks are kept in a buffer from `memory`, null for the default resource.
+l2encdec::DecodeResult decode(std::span<const unsigned char> blocks, const rsa::Key &private_key, std::span<unsigned char> output,
+                              std::pmr::memory_resource *memory = nullptr,
+                              stats::Recorder &stats = stats::Recorder::disabled());
+} // namespace pipeline
+
+#endif // PIPELINE_H
@@ -1,14 +1,22 @@
 #include "rsa.h"
+#include "montgomery.h"
+#include "thread_pool.h"
 #include <algorithm>
 #include <atomic>
+#include <cstring>
 #include <mbedtls/bignum.h>
-#include <thread>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
 
 namespace
 {
-constexpr size_t NUM_THREADS = 4;
-constexpr size_t BLOCK_SIZE = 128;
-constexpr size_t BLOCK_BODY_SIZE = 124;
+using rsa::BLOCK_BODY_SIZE;
+using rsa::BLOCK_SIZE;
+
+constexpr size_t BLOCKS_PER_TASK = 4;
+constexpr size_t INLINE_BLOCK_THRESHOLD = 8;
+constexpr size_t KEY_CACHE_CAPACITY = 16;
 
 struct Mpi
 {
@@ -29,6 +37,34 @@ int mpi_read_hex(mbedtls_mpi *x, const std::string &hex)
     return mbedtls_mpi_read_string(x, 16, hex.c_str());
 }
 
+// `output` must hold `rsa::padded_size(input.size())` bytes
+void pad_blocks(std::span<const unsigned char> input, unsigned char *output)
+{
+    for (size_t input_offset = 0; input_offset < input.size(); output += BLOCK_SIZE)
+    {
+        size_t chunk_size = std::min(input.size() - input_offset, BLOCK_BODY_SIZE);
+        std::fill(output, output + BLOCK_SIZE, 0);
+        output[3] = static_cast<unsigned char>(chunk_size);
+        std::copy(input.begin() + input_offset, input.begin() + input_offset + chunk_size,
+                  output + BLOCK_SIZE - align_to_4_bytes(chunk_size));
+        input_offset += chunk_size;
+    }
+}
+
+// compacts the block bodies to the front of `data`, returns their total size
+size_t remove_padding_inplace(unsigned char *data, size_t size)
+{
+    size_t written = 0;
+    for (size_t offset = 0; offset + BLOCK_SIZE <= size; offset += BLOCK_SIZE)
+    {
+        size_t chunk_size = std::min<size_t>(data[offset + 3], BLOCK_BODY_SIZE);
+        std::memmove(data + written, data + offset + BLOCK_SIZE - align_to_4_bytes(chunk_size), chunk_size);
+        written += chunk_size;
+    }
+
+    return written;
+}
+
 inline void store_first_error(std::atomic<int> &err, int rc)
 {
     int expected = 0;
@@ -36,23 +72,123 @@ inline void store_first_error(std::atomic<int> &err, int rc)
 }
 } // namespace
 
-size_t rsa::add_padding(std::vector<uint8_t> &output, const std::vector<uint8_t> &input)
+struct rsa::Key
 {
-    size_t input_offset = 0;
-    size_t num_blocks = (input.size() + BLOCK_BODY_SIZE - 1) / BLOCK_BODY_SIZE;
-    output.resize(num_blocks * BLOCK_SIZE);
+    Mpi modulus;
+    Mpi exponent;
+    // Montgomery R^2 mod N, filled once by load_key and only read by mbedtls_mpi_exp_mod afterwards
+    mutable Mpi rr;
+    // fixed-width kernel used instead of mbedtls for exponents up to 64 bits
+    bool use_montgomery = false;
+    montgomery::Context montgomery;
+};
 
-    for (size_t output_offset = 0; input_offset < input.size(); output_offset += BLOCK_SIZE)
+namespace
+{
+// runs blocks [begin, end) on the calling thread; `locate(i)` yields the input and output pointers of block `i`, they may alias
+template <typename Locate>
+int exp_mod_range(size_t begin, size_t end, const rsa::Key &key, Locate locate)
+{
+    if (key.use_montgomery)
     {
-        size_t chunk_size = std::min(input.size() - input_offset, BLOCK_BODY_SIZE);
-        std::fill(output.begin() + output_offset, output.begin() + output_offset + BLOCK_SIZE, 0);
-        output[output_offset + 3] = static_cast<uint8_t>(chunk_size);
-        size_t data_offset = output_offset + BLOCK_SIZE - align_to_4_bytes(chunk_size);
-        std::copy(input.begin() + input_offset, input.begin() + input_offset + chunk_size,
-                  output.begin() + data_offset);
-        input_offset += chunk_size;
+        for (size_t i = begin; i < end; ++i)
+        {
+            auto [in, out] = locate(i);
+            montgomery::exp_mod(key.montgomery, in, out);
+        }
+        return 0;
+    }
+
+    Mpi block, result;
+    for (size_t i = begin; i < end; ++i)
+    {
+        auto [in, out] = locate(i);
+
+        int rc = mbedtls_mpi_read_binary(&block.v, in, BLOCK_SIZE);
+        if (rc != 0) return rc;
+
+        rc = mbedtls_mpi_exp_mod(&result.v, &block.v, &key.exponent.v, &key.modulus.v, &key.rr.v);
+        if (rc != 0) return rc;
+
+        rc = mbedtls_mpi_write_binary(&result.v, out, BLOCK_SIZE);
+        if (rc != 0) return rc;
+    }
+
+    return 0;
+}
+
+template <typename Locate>
+int exp_mod_each(size_t total_blocks, const rsa::Key &key, Locate locate)
+{
+    size_t grain = total_blocks <= INLINE_BLOCK_THRESHOLD ? total_blocks : BLOCKS_PER_TASK;
+
+    std::atomic<int> error(0);
+    thread_pool::parallel_for(total_blocks, grain, [&](size_t begin, size_t end)
+                              {
+        if (error.load() != 0) return;
+        if (int rc = exp_mod_range(begin, end, key, locate); rc != 0)
+            store_first_error(error, rc); });
+
+    return error.load();
+}
+
+int exp_mod_blocks(const unsigned char *input,
+                   unsigned char *output,
+                   size_t total_blocks,
+                   const rsa::Key &key)
+{
+    return exp_mod_each(total_blocks, key, [&](size_t i)
+                        { return std::pair(input + i * BLOCK_SIZE, output + i * BLOCK_SIZE); });
+}
+} // namespace
+
+std::shared_ptr<const rsa::Key> rsa::load_key(const std::string &modulus_hex, const std::string &exp_hex)
+{
+    static std::mutex mutex;
+    static std::unordered_map<std::string, std::shared_ptr<const Key>> cache;
+
+    std::string id = modulus_hex + ':' + exp_hex;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (auto it = cache.find(id); it != cache.end())
+        return it->second;
+
+    auto key = std::make_shared<Key>();
+    if (mpi_read_hex(&key->modulus.v, modulus_hex) != 0 ||
+        mpi_read_hex(&key->exponent.v, exp_hex) != 0)
+        return nullptr;
+
+    Mpi one, unused;
+    if (mbedtls_mpi_lset(&one.v, 1) != 0 ||
+        mbedtls_mpi_exp_mod(&unused.v, &one.v, &one.v, &key->modulus.v, &key->rr.v) != 0)
+        return nullptr;
+
+    unsigned char modulus_bytes[montgomery::BYTES];
+    unsigned char exponent_bytes[sizeof(uint64_t)];
+    if (mbedtls_mpi_bitlen(&key->exponent.v) <= montgomery::MAX_EXPONENT_BITS &&
+        mbedtls_mpi_write_binary(&key->modulus.v, modulus_bytes, sizeof(modulus_bytes)) == 0 &&
+        mbedtls_mpi_write_binary(&key->exponent.v, exponent_bytes, sizeof(exponent_bytes)) == 0)
+    {
+        uint64_t exponent = 0;
+        for (unsigned char b : exponent_bytes)
+            exponent = (exponent << 8) | b;
+        key->use_montgomery = montgomery::init(key->montgomery, modulus_bytes, exponent);
     }
 
+    if (cache.size() >= KEY_CACHE_CAPACITY)
+        cache.clear();
+    cache.emplace(std::move(id), key);
+    return key;
+}
+
+size_t rsa::padded_size(size_t size)
+{
+    return (size + BLOCK_BODY_SIZE - 1) / BLOCK_BODY_SIZE * BLOCK_SIZE;
+}
+
+size_t rsa::add_padding(std::vector<uint8_t> &output, const std::vector<uint8_t> &input)
+{
+    output.resize(padded_size(input.size()));
+    pad_blocks(input, output.data());
     return output.size();
 }
 
@@ -73,79 +209,73 @@ size_t rsa::remove_padding(std::vector<uint8_t> &output, const std::vector<uint8
     return output.size();
 }
 
-int rsa::encrypt(const std::vector<unsigned char> &input_data,
-                 std::vector<unsigned char> &output_data,
-                 const std::string &modulus_hex,
-                 const std::string &public_exp_hex)
+size_t rsa::remove_padding(std::span<unsigned char> blocks)
 {
-    std::vector<unsigned char> padded_buffer;
-    size_t total_size = add_padding(padded_buffer, input_data);
-    if (total_size == 0) return -1;
-
-    size_t total_blocks = total_size / BLOCK_SIZE;
-    output_data.resize(total_size);
+    return remove_padding_inplace(blocks.data(), blocks.size());
+}
 
-    Mpi modulus, public_exp;
-    if (mpi_read_hex(&modulus.v, modulus_hex) != 0 ||
-        mpi_read_hex(&public_exp.v, public_exp_hex) != 0)
+void rsa::seal_block(unsigned char *block, size_t body_size)
+{
+    size_t offset = BLOCK_SIZE - align_to_4_bytes(body_size);
+    if (offset != BLOCK_SIZE - BLOCK_BODY_SIZE)
     {
-        output_data.clear();
-        return -2;
+        std::memmove(block + offset, block + BLOCK_SIZE - BLOCK_BODY_SIZE, body_size);
+        std::fill(block + BLOCK_SIZE - BLOCK_BODY_SIZE, block + offset, 0);
     }
+    std::fill(block + offset + body_size, block + BLOCK_SIZE, 0);
+    std::fill(block, block + 3, 0);
+    block[3] = static_cast<unsigned char>(body_size);
+}
 
-    size_t hw = std::thread::hardware_concurrency();
-    size_t num_threads = std::min({hw ? hw : NUM_THREADS, NUM_THREADS, total_blocks});
-    if (num_threads == 0) num_threads = 1;
-
-    std::vector<Mpi> thread_mods(num_threads);
-    std::vector<Mpi> thread_exps(num_threads);
+int rsa::exp_mod(std::span<const unsigned char> input_blocks, std::span<unsigned char> output_blocks, const Key &key)
+{
+    if (input_blocks.size() % BLOCK_SIZE != 0 || output_blocks.size() != input_blocks.size())
+        return -1;
 
-    for (size_t i = 0; i < num_threads; ++i)
-    {
-        int rc = mbedtls_mpi_copy(&thread_mods[i].v, &modulus.v);
-        if (rc != 0) return rc;
-        rc = mbedtls_mpi_copy(&thread_exps[i].v, &public_exp.v);
-        if (rc != 0) return rc;
-    }
+    return exp_mod_range(0, input_blocks.size() / BLOCK_SIZE, key, [&](size_t i)
+                         { return std::pair(input_blocks.data() + i * BLOCK_SIZE, output_blocks.data() + i * BLOCK_SIZE); });
+}
 
-    std::atomic<size_t> next_block(0);
-    std::atomic<int> error(0);
+int rsa::parallel_exp_mod(std::span<const unsigned char> input_blocks, std::span<unsigned char> output_blocks, const Key &key)
+{
+    if (input_blocks.size() % BLOCK_SIZE != 0 || output_blocks.size() != input_blocks.size())
+        return -1;
 
-    std::vector<std::thread> threads;
-    threads.reserve(num_threads);
+    return exp_mod_blocks(input_blocks.data(), output_blocks.data(), input_blocks.size() / BLOCK_SIZE, key);
+}
 
-    for (size_t t = 0; t < num_threads; ++t)
+int rsa::encrypt(const std::vector<unsigned char> &input_data,
+                 std::vector<unsigned char> &output_data,
+                 const std::string &modulus_hex,
+                 const std::string &public_exp_hex)
+{
+    auto key = load_key(modulus_hex, public_exp_hex);
+    if (!key)
     {
-        threads.emplace_back([&, t]()
-                             {
-            Mpi block, encrypted_block;
-            std::vector<unsigned char> temp(BLOCK_SIZE);
-
-            while (true) {
-                size_t i = next_block.fetch_add(1);
-                if (i >= total_blocks) break;
-                if (error.load() != 0) break;
-
-                size_t offset = i * BLOCK_SIZE;
-
-                int rc = mbedtls_mpi_read_binary(&block.v, padded_buffer.data() + offset, BLOCK_SIZE);
-                if (rc != 0) { store_first_error(error, rc); break; }
-
-                rc = mbedtls_mpi_exp_mod(&encrypted_block.v, &block.v,
-                                         &thread_exps[t].v, &thread_mods[t].v, nullptr);
-                if (rc != 0) { store_first_error(error, rc); break; }
+        output_data.clear();
+        return -2;
+    }
 
-                rc = mbedtls_mpi_write_binary(&encrypted_block.v, temp.data(), BLOCK_SIZE);
-                if (rc != 0) { store_first_error(error, rc); break; }
+    return encrypt(input_data, output_data, *key);
+}
 
-                std::copy(temp.begin(), temp.end(), output_data.begin() + offset);
-            } });
-    }
+int rsa::decrypt(const std::vector<unsigned char> &input_data,
+                 std::vector<unsigned char> &output_data,
+                 const std::string &modulus_hex,
+                 const std::string &private_exp_hex)
+{
+    auto key = load_key(modulus_hex, private_exp_hex);
+    if (!key) return -2;
 
-    for (auto &th : threads)
-        th.join();
+    return decrypt(input_data, output_data, *key);
+}
 
-    int rc = error.load();
+int rsa::encrypt(const std::vector<unsigned char> &input_data,
+                 std::vector<unsigned char> &output_data,
+                 const Key &public_key)
+{
+    output_data.resize(padded_size(input_data.size()));
+    int rc = encrypt(std::span(input_data), std::span(output_data), public_key);
     if (rc != 0)
     {
         output_data.clear();
@@ -155,79 +285,62 @@ int rsa::encrypt(const std::vector<unsigned char> &input_data,
     return 0;
 }
 
-int rsa::decrypt(const std::vector<unsigned char> &input_data,
-                 std::vector<unsigned char> &output_data,
-                 const std::string &modulus_hex,
-                 const std::string &private_exp_hex)
+int rsa::encrypt(std::span<const unsigned char> input_data,
+                 std::span<unsigned char> output_data,
+                 const Key &public_key)
 {
-    if (input_data.size() % BLOCK_SIZE != 0) return -1;
+    if (input_data.empty() || output_data.size() != padded_size(input_data.size()))
+        return -1;
+
+    pad_blocks(input_data, output_data.data());
+    return exp_mod_blocks(output_data.data(), output_data.data(), output_data.size() / BLOCK_SIZE, public_key);
+}
 
-    size_t total_blocks = input_data.size() / BLOCK_SIZE;
-    std::vector<unsigned char> decrypted_buffer(input_data.size());
+int rsa::encrypt_batch(const std::vector<std::vector<unsigned char>> &inputs,
+                       std::vector<std::vector<unsigned char>> &outputs,
+                       const Key &public_key)
+{
+    outputs.resize(inputs.size());
 
-    Mpi modulus, private_exp;
-    if (mpi_read_hex(&modulus.v, modulus_hex) != 0 ||
-        mpi_read_hex(&private_exp.v, private_exp_hex) != 0)
+    std::vector<unsigned char *> blocks;
+    for (size_t i = 0; i < inputs.size(); ++i)
     {
-        return -2;
+        size_t total_size = add_padding(outputs[i], inputs[i]);
+        if (total_size == 0)
+        {
+            outputs.clear();
+            return -1;
+        }
+
+        for (size_t offset = 0; offset < total_size; offset += BLOCK_SIZE)
+            blocks.push_back(outputs[i].data() + offset);
     }
 
-    size_t hw = std::thread::hardware_concurrency();
-    size_t num_threads = std::min({hw ? hw : NUM_THREADS, NUM_THREADS, total_blocks});
-    if (num_threads == 0) num_threads = 1;
-
-    std::vector<Mpi> thread_mods(num_threads);
-    std::vector<Mpi> thread_privs(num_threads);
-
-    for (size_t i = 0; i < num_threads; ++i)
+    int rc = exp_mod_each(blocks.size(), public_key, [&](size_t i)
+                          { return std::pair<const unsigned char *, unsigned char *>(blocks[i], blocks[i]); });
+    if (rc != 0)
     {
-        int rc = mbedtls_mpi_copy(&thread_mods[i].v, &modulus.v);
-        if (rc != 0) return rc;
-        rc = mbedtls_mpi_copy(&thread_privs[i].v, &private_exp.v);
-        if (rc != 0) return rc;
+        outputs.clear();
+        return rc;
     }
 
-    std::atomic<size_t> next_block(0);
-    std::atomic<int> error(0);
+    return 0;
+}
 
-    std::vector<std::thread> threads;
-    threads.reserve(num_threads);
+int rsa::decrypt(std::span<const unsigned char> input_data,
+                 std::vector<unsigned char> &output_data,
+                 const Key &private_key)
+{
+    if (input_data.size() % BLOCK_SIZE != 0) return -1;
 
-    for (size_t t = 0; t < num_threads; ++t)
+    output_data.resize(input_data.size());
+    int rc = exp_mod_blocks(input_data.data(), output_data.data(), input_data.size() / BLOCK_SIZE, private_key);
+    if (rc != 0)
     {
-        threads.emplace_back([&, t]()
-                             {
-            Mpi block, decrypted_block;
-            std::vector<unsigned char> temp(BLOCK_SIZE);
-
-            while (true) {
-                size_t i = next_block.fetch_add(1);
-                if (i >= total_blocks) break;
-                if (error.load() != 0) break;
-
-                size_t offset = i * BLOCK_SIZE;
-
-                int rc = mbedtls_mpi_read_binary(&block.v, input_data.data() + offset, BLOCK_SIZE);
-                if (rc != 0) { store_first_error(error, rc); break; }
-
-                rc = mbedtls_mpi_exp_mod(&decrypted_block.v, &block.v,
-                                         &thread_privs[t].v, &thread_mods[t].v, nullptr);
-                if (rc != 0) { store_first_error(error, rc); break; }
-
-                rc = mbedtls_mpi_write_binary(&decrypted_block.v, temp.data(), BLOCK_SIZE);
-                if (rc != 0) { store_first_error(error, rc); break; }
-
-                std::copy(temp.begin(), temp.end(), decrypted_buffer.begin() + offset);
-            } });
+        output_data.clear();
+        return rc;
     }
 
-    for (auto &th : threads)
-        th.join();
-
-    int rc = error.load();
-    if (rc != 0) return rc;
-
-    output_data.clear();
-    remove_padding(output_data, decrypted_buffer);
+    output_data.resize(remove_padding_inplace(output_data.data(), output_data.size()));
     return 0;
 }
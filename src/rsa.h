@@ -2,15 +2,39 @@
 #define RSA_H
 
 #include <cstdint>
+#include <memory>
+#include <span>
 #include <string>
 #include <vector>
 
 namespace rsa
 {
+constexpr size_t BLOCK_SIZE = 128;
+constexpr size_t BLOCK_BODY_SIZE = 124;
+
+struct Key;
+
+std::shared_ptr<const Key> load_key(const std::string &modulus_hex, const std::string &exp_hex);
+// size of `size` bytes split into 124-byte bodies and padded to 128-byte blocks
+size_t padded_size(size_t size);
 size_t add_padding(std::vector<uint8_t> &output, const std::vector<uint8_t> &input);
 size_t remove_padding(std::vector<uint8_t> &output, const std::vector<uint8_t> &input);
+// compacts the bodies of `blocks` to its front, returns their total size
+size_t remove_padding(std::span<unsigned char> blocks);
+// pads a block whose `body_size` bytes were written right after its 4-byte header
+void seal_block(unsigned char *block, size_t body_size);
+// encrypts or decrypts whole blocks on the calling thread; `input_blocks` and `output_blocks` may alias
+int exp_mod(std::span<const unsigned char> input_blocks, std::span<unsigned char> output_blocks, const Key &key);
+// same as `exp_mod`, spread over the shared thread pool
+int parallel_exp_mod(std::span<const unsigned char> input_blocks, std::span<unsigned char> output_blocks, const Key &key);
 int encrypt(const std::vector<unsigned char> &input_data, std::vector<unsigned char> &output_data, const std::string &modulus_hex, const std::string &public_exp_hex);
 int decrypt(const std::vector<unsigned char> &input_data, std::vector<unsigned char> &output_data, const std::string &modulus_hex, const std::string &private_exp_hex);
+int encrypt(const std::vector<unsigned char> &input_data, std::vector<unsigned char> &output_data, const Key &public_key);
+int decrypt(std::span<const unsigned char> input_data, std::vector<unsigned char> &output_data, const Key &private_key);
+// `output_data` must be exactly `padded_size(input_data.size())` bytes
+int encrypt(std::span<const unsigned char> input_data, std::span<unsigned char> output_data, const Key &public_key);
+// pads every input and runs all of their blocks through the pool as one job
+int encrypt_batch(const std::vector<std::vector<unsigned char>> &inputs, std::vector<std::vector<unsigned char>> &outputs, const Key &public_key);
 } // namespace rsa
 
 #endif // RSA_H
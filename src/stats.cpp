@@ -0,0 +1,92 @@
+#include "stats.h"
+#include <algorithm>
+
+stats::Recorder::Scope::Scope(Recorder *recorder, Stage stage)
+    : recorder_(recorder),
+      stage_(stage)
+{
+    if (recorder_)
+        start_ = std::chrono::steady_clock::now();
+}
+
+stats::Recorder::Scope::~Scope()
+{
+    if (recorder_)
+        recorder_->add_time(stage_, std::chrono::steady_clock::now() - start_);
+}
+
+stats::Recorder::Recorder(l2encdec::Stats *sink)
+    : sink_(sink)
+{
+    if (sink_)
+        start_ = std::chrono::steady_clock::now();
+}
+
+stats::Recorder::~Recorder()
+{
+    if (!sink_)
+        return;
+
+    auto stage = [this](Stage s)
+    { return std::chrono::nanoseconds(stage_ns_[static_cast<size_t>(s)].load()); };
+
+    l2encdec::Stats &s = *sink_;
+    s.total += std::chrono::steady_clock::now() - start_;
+    s.copy += stage(Stage::COPY);
+    s.transform += stage(Stage::TRANSFORM);
+    s.deflate += stage(Stage::DEFLATE);
+    s.inflate += stage(Stage::INFLATE);
+    s.rsa += stage(Stage::RSA);
+    s.padding += stage(Stage::PADDING);
+    s.checksum += stage(Stage::CHECKSUM);
+    s.bytes_in += bytes_in_;
+    s.bytes_out += bytes_out_;
+    s.rsa_blocks += rsa_blocks_.load();
+    s.threads = std::max(s.threads, std::max<size_t>(threads_.size(), 1));
+    s.allocations += allocations_;
+    s.peak_buffer_size = std::max(s.peak_buffer_size, peak_buffer_size_);
+}
+
+stats::Recorder &stats::Recorder::disabled()
+{
+    static Recorder recorder(nullptr);
+    return recorder;
+}
+
+void stats::Recorder::add_time(Stage stage, std::chrono::nanoseconds elapsed)
+{
+    if (!sink_)
+        return;
+
+    stage_ns_[static_cast<size_t>(stage)] += elapsed.count();
+
+    auto id = std::this_thread::get_id();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (std::find(threads_.begin(), threads_.end(), id) == threads_.end())
+        threads_.push_back(id);
+}
+
+void stats::Recorder::add_bytes(size_t in, size_t out)
+{
+    if (!sink_)
+        return;
+
+    bytes_in_ += in;
+    bytes_out_ += out;
+}
+
+void stats::Recorder::add_rsa_blocks(size_t count)
+{
+    if (sink_)
+        rsa_blocks_ += count;
+}
+
+void stats::Recorder::allocated(size_t size)
+{
+    if (!sink_)
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++allocations_;
+    peak_buffer_size_ = std::max(peak_buffer_size_, size);
+}
@@ -0,0 +1,78 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <l2encdec.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// collects l2encdec::Stats for one call from every thread working on it; without a sink every call is a null check
+namespace stats
+{
+enum class Stage
+{
+    COPY,
+    TRANSFORM,
+    DEFLATE,
+    INFLATE,
+    RSA,
+    PADDING,
+    CHECKSUM,
+    COUNT,
+};
+
+class Recorder
+{
+public:
+    // adds the elapsed time to `stage` when it goes out of scope
+    class Scope
+    {
+    public:
+        Scope(Recorder *recorder, Stage stage);
+        ~Scope();
+
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+    private:
+        Recorder *recorder_;
+        Stage stage_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+    // adds to `sink`, if any, when destroyed
+    explicit Recorder(l2encdec::Stats *sink);
+    ~Recorder();
+
+    Recorder(const Recorder &) = delete;
+    Recorder &operator=(const Recorder &) = delete;
+
+    // shared recorder without a sink, the default for internal functions
+    static Recorder &disabled();
+
+    bool enabled() const { return sink_ != nullptr; }
+    Scope time(Stage stage) { return Scope(enabled() ? this : nullptr, stage); }
+
+    void add_time(Stage stage, std::chrono::nanoseconds elapsed);
+    void add_bytes(size_t in, size_t out);
+    void add_rsa_blocks(size_t count);
+    void allocated(size_t size);
+
+private:
+    l2encdec::Stats *sink_;
+    std::chrono::steady_clock::time_point start_;
+    std::atomic<int64_t> stage_ns_[static_cast<size_t>(Stage::COUNT)] = {};
+    std::atomic<size_t> rsa_blocks_{0};
+    size_t bytes_in_ = 0;
+    size_t bytes_out_ = 0;
+    size_t allocations_ = 0;
+    size_t peak_buffer_size_ = 0;
+    std::mutex mutex_;
+    std::vector<std::thread::id> threads_;
+};
+} // namespace stats
+
+#endif // STATS_H
@@ -0,0 +1,476 @@
+#include "blowfish.h"
+#include "l2encdec_private.h" // IWYU pragma: keep
+#include "layout.h"
+#include "memory.h"
+#include "pipeline.h"
+#include "rsa.h"
+#include "utils.h"
+#include "xor_utils.h"
+#include "zlib_utils.h"
+#include <algorithm>
+#include <cstring>
+#include <optional>
+
+namespace
+{
+using l2encdec::Type;
+using rsa::BLOCK_BODY_SIZE;
+using rsa::BLOCK_SIZE;
+
+// bytes transformed per call to the writer, which bounds the scratch buffers; a whole number of RSA blocks
+constexpr size_t SLICE_SIZE = 1024 * 1024;
+constexpr size_t BLOWFISH_BLOCK_SIZE = 8;
+// get_key_by_index only looks at the low 16 bits of the index
+constexpr size_t XOR_KEYSTREAM_PERIOD = 0x10000;
+
+using Output = std::function<void(std::span<const unsigned char> data)>;
+
+std::span<const unsigned char> as_uchars(std::span<const std::byte> data)
+{
+    return {reinterpret_cast<const unsigned char *>(data.data()), data.size()};
+}
+
+// length-preserving transform of every type except l2encdec::Type::RSA, applied to consecutive pieces of the body
+class BodyStream
+{
+public:
+    BodyStream(const l2encdec::Params &p, bool encrypt)
+        : type_(p.type),
+          encrypt_(encrypt),
+          xor_key_(p.type == Type::XOR_FILENAME ? xor_utils::get_key_by_filename(p.filename) : p.xor_key),
+          xor_start_position_(p.xor_start_position)
+    {
+        if (type_ == Type::BLOWFISH)
+            blowfish_key_ = blowfish::load_key(p.blowfish_key);
+    }
+
+    // holds back a partial Blowfish block until the next piece completes it
+    void feed(std::span<const unsigned char> input, const Output &output)
+    {
+        if (type_ == Type::BLOWFISH)
+        {
+            if (!pending_.empty())
+            {
+                size_t take = std::min(BLOWFISH_BLOCK_SIZE - pending_.size(), input.size());
+                pending_.insert(pending_.end(), input.begin(), input.begin() + take);
+                input = input.subspan(take);
+                if (pending_.size() < BLOWFISH_BLOCK_SIZE)
+                    return;
+
+                transform(pending_, pending_);
+                output(pending_);
+                pending_.clear();
+            }
+
+            size_t whole = input.size() / BLOWFISH_BLOCK_SIZE * BLOWFISH_BLOCK_SIZE;
+            pending_.assign(input.begin() + whole, input.end());
+            input = input.first(whole);
+        }
+
+        while (!input.empty())
+        {
+            size_t size = std::min(SLICE_SIZE, input.size());
+            scratch_.resize(size);
+            transform(input.first(size), scratch_);
+            output(scratch_);
+            input = input.subspan(size);
+        }
+    }
+
+    // a trailing partial Blowfish block stays as is, like in the one-shot transforms
+    void finish(const Output &output)
+    {
+        if (!pending_.empty())
+            output(pending_);
+        pending_.clear();
+    }
+
+private:
+    void transform(std::span<const unsigned char> input, std::span<unsigned char> output)
+    {
+        switch (type_)
+        {
+        case Type::XOR:
+        case Type::XOR_FILENAME:
+            xor_utils::apply(input, output, xor_key_);
+            break;
+        case Type::XOR_POSITION:
+            xor_utils::apply_position(input, output, xor_start_position_ + static_cast<int>(offset_ % XOR_KEYSTREAM_PERIOD));
+            break;
+        case Type::BLOWFISH:
+            if (encrypt_)
+                blowfish::encrypt(input, output, *blowfish_key_);
+            else
+                blowfish::decrypt(input, output, *blowfish_key_);
+            break;
+        default:
+            if (input.data() != output.data())
+                std::copy(input.begin(), input.end(), output.begin());
+            break;
+        }
+        offset_ += input.size();
+    }
+
+    Type type_;
+    bool encrypt_;
+    int xor_key_;
+    int xor_start_position_;
+    std::shared_ptr<const blowfish::Key> blowfish_key_;
+    size_t offset_ = 0;
+    std::vector<unsigned char> pending_;
+    std::vector<unsigned char> scratch_;
+};
+} // namespace
+
+struct l2encdec::Encoder::State
+{
+    State(const Params &p, Writer w, size_t size)
+        : params(p),
+          writer(std::move(w))
+    {
+        if (!layout::has_valid_header(params))
+        {
+            result = EncodeResult::INVALID_TYPE;
+            return;
+        }
+
+        if (params.type != Type::RSA)
+        {
+            body.emplace(params, true);
+            return;
+        }
+
+        rsa_key = rsa::load_key(params.rsa_modulus, params.rsa_public_exponent);
+        if (!rsa_key)
+            result = EncodeResult::ENCRYPTION_FAILED;
+        else if (size != UNKNOWN_SIZE)
+            packer.emplace(size, params.compression_level, [this](std::span<const unsigned char> chunk)
+                           { fill_blocks(chunk); });
+    }
+
+    void write(std::span<const unsigned char> data)
+    {
+        crc = zlib_utils::checksum(data, crc);
+        writer(std::as_bytes(data));
+    }
+
+    void write_header()
+    {
+        if (header_written || params.skip_header)
+            return;
+
+        std::string header = layout::header(params);
+        std::vector<unsigned char> wide(header.size() * 2);
+        utils::write_header(wide.data(), header);
+        write(wide);
+        header_written = true;
+    }
+
+    // packed bytes go straight into the bodies of padded blocks
+    void fill_blocks(std::span<const unsigned char> chunk)
+    {
+        while (!chunk.empty())
+        {
+            if (filled == 0)
+                blocks.resize(blocks.size() + BLOCK_SIZE);
+
+            unsigned char *block = blocks.data() + blocks.size() - BLOCK_SIZE;
+            size_t size = std::min(BLOCK_BODY_SIZE - filled, chunk.size());
+            std::memcpy(block + BLOCK_SIZE - BLOCK_BODY_SIZE + filled, chunk.data(), size);
+            filled += size;
+            chunk = chunk.subspan(size);
+
+            if (filled == BLOCK_BODY_SIZE)
+            {
+                rsa::seal_block(block, filled);
+                filled = 0;
+            }
+        }
+    }
+
+    // encrypts and writes every sealed block, and the partial one too if `last`
+    EncodeResult flush_blocks(bool last)
+    {
+        if (last && filled != 0)
+        {
+            rsa::seal_block(blocks.data() + blocks.size() - BLOCK_SIZE, filled);
+            filled = 0;
+        }
+
+        auto sealed = std::span(blocks).first(blocks.size() - (filled != 0 ? BLOCK_SIZE : 0));
+        if (sealed.empty())
+            return EncodeResult::SUCCESS;
+        if (rsa::parallel_exp_mod(sealed, sealed, *rsa_key) != 0)
+            return EncodeResult::ENCRYPTION_FAILED;
+
+        write(sealed);
+        blocks.erase(blocks.begin(), blocks.begin() + sealed.size());
+        return EncodeResult::SUCCESS;
+    }
+
+    Params params;
+    Writer writer;
+    EncodeResult result = EncodeResult::SUCCESS;
+    bool finished = false;
+    bool header_written = false;
+    uint32_t crc = 0;
+    std::optional<BodyStream> body;
+
+    std::shared_ptr<const rsa::Key> rsa_key;
+    std::optional<zlib_utils::StreamPack> packer;
+    std::vector<unsigned char> blocks;
+    // body bytes in the last of `blocks`, 0 once it is sealed
+    size_t filled = 0;
+    // input of l2encdec::Type::RSA when its size is unknown
+    std::vector<unsigned char> held_input;
+};
+
+l2encdec::Encoder::Encoder(const Params &params, Writer writer, size_t input_size)
+    : state_(std::make_unique<State>(params, std::move(writer), input_size))
+{
+}
+
+l2encdec::Encoder::~Encoder() = default;
+
+l2encdec::EncodeResult l2encdec::Encoder::feed(std::span<const std::byte> input_data)
+{
+    State &s = *state_;
+    if (s.result != EncodeResult::SUCCESS)
+        return s.result;
+    if (s.finished)
+        return EncodeResult::ALREADY_FINISHED;
+
+    s.write_header();
+    auto input = as_uchars(input_data);
+
+    if (s.body)
+    {
+        s.body->feed(input, [&s](std::span<const unsigned char> data)
+                     { s.write(data); });
+        return EncodeResult::SUCCESS;
+    }
+
+    if (!s.packer)
+    {
+        s.held_input.insert(s.held_input.end(), input.begin(), input.end());
+        return EncodeResult::SUCCESS;
+    }
+
+    // encrypting after every slice keeps at most a slice worth of blocks around
+    while (!input.empty())
+    {
+        size_t size = std::min(SLICE_SIZE, input.size());
+        if (s.packer->feed(input.first(size)) != 0)
+            return s.result = EncodeResult::COMPRESSION_FAILED;
+        if ((s.result = s.flush_blocks(false)) != EncodeResult::SUCCESS)
+            return s.result;
+        input = input.subspan(size);
+    }
+
+    return EncodeResult::SUCCESS;
+}
+
+l2encdec::EncodeResult l2encdec::Encoder::finish()
+{
+    State &s = *state_;
+    if (s.result != EncodeResult::SUCCESS)
+        return s.result;
+    if (s.finished)
+        return EncodeResult::ALREADY_FINISHED;
+    s.finished = true;
+
+    s.write_header();
+
+    if (s.body)
+    {
+        s.body->finish([&s](std::span<const unsigned char> data)
+                       { s.write(data); });
+    }
+    else if (s.packer)
+    {
+        if (s.packer->finish() != 0)
+            return s.result = EncodeResult::COMPRESSION_FAILED;
+        if ((s.result = s.flush_blocks(true)) != EncodeResult::SUCCESS)
+            return s.result;
+    }
+    else
+    {
+        memory::Scratch encrypted(s.params.memory_resource);
+        if ((s.result = pipeline::encode(s.held_input, s.params.compression_level, *s.rsa_key, encrypted)) != EncodeResult::SUCCESS)
+            return s.result;
+        std::vector<unsigned char>().swap(s.held_input);
+        s.write(encrypted.span());
+    }
+
+    if (!s.params.skip_tail)
+    {
+        std::string tail = layout::tail(s.params, s.crc);
+        std::vector<unsigned char> bytes(utils::tail_size(tail));
+        utils::write_tail(bytes.data(), tail);
+        s.write(bytes);
+    }
+
+    return EncodeResult::SUCCESS;
+}
+
+struct l2encdec::Decoder::State
+{
+    State(const Params &p, Writer w)
+        : params(p),
+          writer(std::move(w)),
+          header_size(layout::header_size(params)),
+          tail_size(layout::decode_tail_size(params)),
+          hold(std::max(tail_size, layout::TAIL_SIZE))
+    {
+        if (params.type != Type::RSA)
+        {
+            body.emplace(params, false);
+            return;
+        }
+
+        rsa_key = rsa::load_key(params.rsa_modulus, params.rsa_private_exponent);
+        if (!rsa_key)
+            result = DecodeResult::DECRYPTION_FAILED;
+        unpacker.emplace([this](std::span<const unsigned char> data)
+                         { write(data); });
+    }
+
+    void write(std::span<const unsigned char> data)
+    {
+        writer(std::as_bytes(data));
+    }
+
+    // `data` lies before both the checksummed range's end and the tail
+    void release(std::span<const unsigned char> data)
+    {
+        crc = zlib_utils::checksum(data, crc);
+        take_payload(data);
+    }
+
+    // drops whatever part of `data` is still header and decodes the rest
+    void take_payload(std::span<const unsigned char> data)
+    {
+        size_t skip = std::min(data.size(), header_size - std::min(position, header_size));
+        position += data.size();
+        data = data.subspan(skip);
+
+        if (body)
+        {
+            body->feed(data, [this](std::span<const unsigned char> decoded)
+                       { write(decoded); });
+            return;
+        }
+
+        while (!data.empty() && result == DecodeResult::SUCCESS)
+        {
+            size_t take = std::min(SLICE_SIZE - blocks.size(), data.size());
+            blocks.insert(blocks.end(), data.begin(), data.begin() + take);
+            data = data.subspan(take);
+
+            auto whole = std::span(blocks).first(blocks.size() / BLOCK_SIZE * BLOCK_SIZE);
+            if (whole.empty())
+                continue;
+
+            if (rsa::parallel_exp_mod(whole, whole, *rsa_key) != 0)
+                result = DecodeResult::DECRYPTION_FAILED;
+            else if (unpacker->feed(whole.first(rsa::remove_padding(whole))) != 0)
+                result = DecodeResult::DECOMPRESSION_FAILED;
+            blocks.erase(blocks.begin(), blocks.begin() + whole.size());
+        }
+    }
+
+    Params params;
+    Writer writer;
+    DecodeResult result = DecodeResult::SUCCESS;
+    bool finished = false;
+    ChecksumResult checksum = ChecksumResult::MISMATCH;
+    size_t header_size;
+    size_t tail_size;
+    // the last bytes seen may still turn out to be the tail
+    size_t hold;
+    std::vector<unsigned char> held;
+    // bytes released so far
+    size_t position = 0;
+    uint32_t crc = 0;
+    std::optional<BodyStream> body;
+
+    std::shared_ptr<const rsa::Key> rsa_key;
+    std::optional<zlib_utils::StreamUnpack> unpacker;
+    // encrypted bytes short of a whole slice
+    std::vector<unsigned char> blocks;
+};
+
+l2encdec::Decoder::Decoder(const Params &params, Writer writer)
+    : state_(std::make_unique<State>(params, std::move(writer)))
+{
+}
+
+l2encdec::Decoder::~Decoder() = default;
+
+l2encdec::DecodeResult l2encdec::Decoder::feed(std::span<const std::byte> input_data)
+{
+    State &s = *state_;
+    if (s.result != DecodeResult::SUCCESS)
+        return s.result;
+    if (s.finished)
+        return DecodeResult::ALREADY_FINISHED;
+
+    auto input = as_uchars(input_data);
+    if (s.held.size() + input.size() <= s.hold)
+    {
+        s.held.insert(s.held.end(), input.begin(), input.end());
+        return DecodeResult::SUCCESS;
+    }
+
+    size_t released = s.held.size() + input.size() - s.hold;
+    size_t from_held = std::min(released, s.held.size());
+    s.release(std::span(s.held).first(from_held));
+    s.held.erase(s.held.begin(), s.held.begin() + from_held);
+
+    size_t from_input = released - from_held;
+    s.release(input.first(from_input));
+    s.held.insert(s.held.end(), input.begin() + from_input, input.end());
+    return s.result;
+}
+
+l2encdec::DecodeResult l2encdec::Decoder::finish()
+{
+    State &s = *state_;
+    if (s.result != DecodeResult::SUCCESS)
+        return s.result;
+    if (s.finished)
+        return DecodeResult::ALREADY_FINISHED;
+    s.finished = true;
+
+    if (s.held.size() >= layout::TAIL_SIZE)
+    {
+        size_t checked = s.held.size() - layout::TAIL_SIZE;
+        uint32_t stored;
+        std::memcpy(&stored, s.held.data() + checked + layout::TAIL_CRC32_OFFSET, sizeof(stored));
+        s.checksum = zlib_utils::checksum(std::span(s.held).first(checked), s.crc) == stored
+                         ? ChecksumResult::SUCCESS
+                         : ChecksumResult::MISMATCH;
+    }
+
+    if (s.position + s.held.size() < s.header_size + s.tail_size)
+        return s.result = DecodeResult::INVALID_TYPE;
+
+    s.take_payload(std::span(s.held).first(s.held.size() - s.tail_size));
+    if (s.result != DecodeResult::SUCCESS)
+        return s.result;
+
+    if (s.body)
+        s.body->finish([&s](std::span<const unsigned char> data)
+                       { s.write(data); });
+    else if (!s.blocks.empty())
+        return s.result = DecodeResult::DECRYPTION_FAILED;
+    else if (s.unpacker->finish() != 0)
+        return s.result = DecodeResult::DECOMPRESSION_FAILED;
+
+    return DecodeResult::SUCCESS;
+}
+
+l2encdec::ChecksumResult l2encdec::Decoder::verify_checksum() const
+{
+    return state_->checksum;
+}
@@ -0,0 +1,163 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+constexpr size_t DEFAULT_CONCURRENCY = 4;
+
+// 0 means every pool thread may help
+std::atomic<size_t> thread_limit{0};
+
+struct Job
+{
+    const thread_pool::Task *task;
+    size_t count;
+    size_t grain;
+    size_t ranges;
+    // workers allowed to join besides the calling thread
+    size_t max_helpers;
+    std::atomic<size_t> next_range{0};
+    size_t active = 0;
+};
+
+void run_ranges(Job &job)
+{
+    while (true)
+    {
+        size_t range = job.next_range.fetch_add(1);
+        if (range >= job.ranges)
+            break;
+
+        size_t begin = range * job.grain;
+        (*job.task)(begin, std::min(begin + job.grain, job.count));
+    }
+}
+
+class Pool
+{
+public:
+    Pool()
+    {
+        size_t hw = std::thread::hardware_concurrency();
+        concurrency_ = hw ? hw : DEFAULT_CONCURRENCY;
+
+        workers_.reserve(concurrency_ - 1);
+        for (size_t i = 1; i < concurrency_; ++i)
+            workers_.emplace_back([this]()
+                                  { worker_loop(); });
+    }
+
+    ~Pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        work_cv_.notify_all();
+        for (auto &worker : workers_)
+            worker.join();
+    }
+
+    Pool(const Pool &) = delete;
+    Pool &operator=(const Pool &) = delete;
+
+    size_t concurrency() const { return concurrency_; }
+
+    void run(Job &job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back(&job);
+        }
+        work_cv_.notify_all();
+
+        run_ranges(job);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto it = std::find(jobs_.begin(), jobs_.end(), &job);
+        if (it != jobs_.end())
+            jobs_.erase(it);
+        done_cv_.wait(lock, [&]()
+                      { return job.active == 0; });
+    }
+
+private:
+    void worker_loop()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true)
+        {
+            work_cv_.wait(lock, [this]()
+                          { return stop_ || !jobs_.empty(); });
+            if (stop_)
+                return;
+
+            Job *job = jobs_.front();
+            if (job->next_range.load() >= job->ranges)
+            {
+                jobs_.pop_front();
+                continue;
+            }
+
+            if (++job->active >= job->max_helpers)
+                jobs_.pop_front();
+            lock.unlock();
+            run_ranges(*job);
+            lock.lock();
+            if (--job->active == 0)
+                done_cv_.notify_all();
+        }
+    }
+
+    size_t concurrency_;
+    std::vector<std::thread> workers_;
+    std::deque<Job *> jobs_;
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    bool stop_ = false;
+};
+
+Pool &shared_pool()
+{
+    static Pool pool;
+    return pool;
+}
+} // namespace
+
+size_t thread_pool::concurrency()
+{
+    size_t limit = thread_limit.load();
+    size_t available = shared_pool().concurrency();
+    return limit == 0 ? available : std::min(limit, available);
+}
+
+void thread_pool::set_max_threads(size_t count)
+{
+    thread_limit.store(count);
+}
+
+void thread_pool::parallel_for(size_t count, size_t grain, const Task &task)
+{
+    if (count == 0)
+        return;
+
+    grain = std::max<size_t>(grain, 1);
+    size_t ranges = (count + grain - 1) / grain;
+
+    size_t threads = concurrency();
+    if (ranges == 1 || threads == 1)
+    {
+        task(0, count);
+        return;
+    }
+
+    Job job{.task = &task, .count = count, .grain = grain, .ranges = ranges, .max_helpers = threads - 1};
+    shared_pool().run(job);
+}
@@ -0,0 +1,18 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <cstddef>
+#include <functional>
+
+namespace thread_pool
+{
+using Task = std::function<void(size_t begin, size_t end)>;
+
+// threads a parallel_for may use, including the caller
+size_t concurrency();
+// caps concurrency() for jobs started afterwards; 0 restores the hardware default
+void set_max_threads(size_t count);
+void parallel_for(size_t count, size_t grain, const Task &task);
+} // namespace thread_pool
+
+#endif // THREAD_POOL_H
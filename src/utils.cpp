@@ -4,19 +4,19 @@
 
 void utils::add_header(std::vector<unsigned char> &data, std::string_view header)
 {
-    const size_t wide_size = header.size() * 2;
-    data.reserve(data.size() + wide_size);
+    std::vector<unsigned char> wide(header.size() * 2);
+    write_header(wide.data(), header);
 
-    std::vector<unsigned char> wide;
-    wide.resize(wide_size);
+    data.insert(data.begin(), wide.begin(), wide.end());
+}
 
+void utils::write_header(unsigned char *output, std::string_view header)
+{
     for (size_t i = 0; i < header.size(); i++)
     {
-        wide[i * 2] = static_cast<unsigned char>(header[i]);
-        wide[i * 2 + 1] = 0;
+        output[i * 2] = static_cast<unsigned char>(header[i]);
+        output[i * 2 + 1] = 0;
     }
-
-    data.insert(data.begin(), wide.begin(), wide.end());
 }
 
 std::string utils::make_tail(uint32_t crc, size_t crc32_offset, size_t tail_size)
@@ -34,17 +34,23 @@ std::string utils::make_tail(uint32_t crc, size_t crc32_offset, size_t tail_size
 }
 
 void utils::add_tail(std::vector<unsigned char> &data, std::string_view tail)
+{
+    size_t offset = data.size();
+    data.resize(offset + tail_size(tail));
+    write_tail(data.data() + offset, tail);
+}
+
+size_t utils::tail_size(std::string_view tail)
+{
+    return (tail.size() + 1) / 2;
+}
+
+void utils::write_tail(unsigned char *output, std::string_view tail)
 {
     std::string padded = std::string(tail);
     if (padded.size() % 2 != 0)
         padded.insert(padded.begin(), '0');
 
-    const size_t byte_count = padded.size() / 2;
-    data.reserve(data.size() + byte_count);
-
     for (size_t i = 0; i < padded.size(); i += 2)
-    {
-        unsigned char value = static_cast<unsigned char>(std::stoi(padded.substr(i, 2), nullptr, 16));
-        data.push_back(value);
-    }
+        *output++ = static_cast<unsigned char>(std::stoi(padded.substr(i, 2), nullptr, 16));
 }
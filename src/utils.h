@@ -11,6 +11,11 @@ namespace utils
 void add_header(std::vector<unsigned char> &data, std::string_view header);
 std::string make_tail(uint32_t crc, size_t crc32_offset, size_t tail_size);
 void add_tail(std::vector<unsigned char> &data, std::string_view tail);
+// writes `header` as UTF-16LE, `header.size() * 2` bytes
+void write_header(unsigned char *output, std::string_view header);
+// number of bytes `write_tail` produces for the hex string `tail`
+size_t tail_size(std::string_view tail);
+void write_tail(unsigned char *output, std::string_view tail);
 } // namespace utils
 
 #endif // UTILS_H
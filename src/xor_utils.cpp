@@ -1,7 +1,27 @@
 #include "xor_utils.h"
+#include "cpu_features.h"
 #include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
 
-int xor_utils::get_key_by_index(int index)
+#if defined(L2ENCDEC_X86)
+#include <immintrin.h>
+#elif defined(L2ENCDEC_ARM64)
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+// get_key_by_index only looks at the low 16 bits of the index
+constexpr size_t KEYSTREAM_PERIOD = 0x10000;
+
+// out[i] = in[i] ^ key[i]; `in` and `out` may alias
+using XorStream = void (*)(const unsigned char *in, const unsigned char *key, unsigned char *out, size_t size);
+// out[i] = in[i] ^ key; `in` and `out` may alias
+using XorByte = void (*)(const unsigned char *in, unsigned char key, unsigned char *out, size_t size);
+
+constexpr int key_by_index(int index)
 {
     int d1 = index & 0xf;
     int d2 = (index >> 4) & 0xf;
@@ -10,6 +30,152 @@ int xor_utils::get_key_by_index(int index)
     return ((d2 ^ d4) << 4) | (d1 ^ d3);
 }
 
+constexpr std::array<unsigned char, KEYSTREAM_PERIOD> make_keystream()
+{
+    std::array<unsigned char, KEYSTREAM_PERIOD> keystream{};
+    for (size_t i = 0; i < KEYSTREAM_PERIOD; ++i)
+        keystream[i] = static_cast<unsigned char>(key_by_index(static_cast<int>(i)));
+    return keystream;
+}
+
+void xor_stream_scalar(const unsigned char *in, const unsigned char *key, unsigned char *out, size_t size)
+{
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+    {
+        uint64_t data, mask;
+        std::memcpy(&data, in + i, sizeof(data));
+        std::memcpy(&mask, key + i, sizeof(mask));
+        data ^= mask;
+        std::memcpy(out + i, &data, sizeof(data));
+    }
+    for (; i < size; ++i)
+        out[i] = in[i] ^ key[i];
+}
+
+void xor_byte_scalar(const unsigned char *in, unsigned char key, unsigned char *out, size_t size)
+{
+    uint64_t mask = 0x0101010101010101ULL * key;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+    {
+        uint64_t data;
+        std::memcpy(&data, in + i, sizeof(data));
+        data ^= mask;
+        std::memcpy(out + i, &data, sizeof(data));
+    }
+    for (; i < size; ++i)
+        out[i] = in[i] ^ key;
+}
+
+#if defined(L2ENCDEC_X86)
+L2ENCDEC_TARGET("sse2")
+void xor_stream_sse2(const unsigned char *in, const unsigned char *key, unsigned char *out, size_t size)
+{
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+        __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i *>(key + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_xor_si128(data, mask));
+    }
+    xor_stream_scalar(in + i, key + i, out + i, size - i);
+}
+
+L2ENCDEC_TARGET("sse2")
+void xor_byte_sse2(const unsigned char *in, unsigned char key, unsigned char *out, size_t size)
+{
+    __m128i mask = _mm_set1_epi8(static_cast<char>(key));
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_xor_si128(data, mask));
+    }
+    xor_byte_scalar(in + i, key, out + i, size - i);
+}
+
+L2ENCDEC_TARGET("avx2")
+void xor_stream_avx2(const unsigned char *in, const unsigned char *key, unsigned char *out, size_t size)
+{
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i));
+        __m256i mask = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(key + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_xor_si256(data, mask));
+    }
+    xor_stream_scalar(in + i, key + i, out + i, size - i);
+}
+
+L2ENCDEC_TARGET("avx2")
+void xor_byte_avx2(const unsigned char *in, unsigned char key, unsigned char *out, size_t size)
+{
+    __m256i mask = _mm256_set1_epi8(static_cast<char>(key));
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_xor_si256(data, mask));
+    }
+    xor_byte_scalar(in + i, key, out + i, size - i);
+}
+#elif defined(L2ENCDEC_ARM64)
+void xor_stream_neon(const unsigned char *in, const unsigned char *key, unsigned char *out, size_t size)
+{
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+        vst1q_u8(out + i, veorq_u8(vld1q_u8(in + i), vld1q_u8(key + i)));
+    xor_stream_scalar(in + i, key + i, out + i, size - i);
+}
+
+void xor_byte_neon(const unsigned char *in, unsigned char key, unsigned char *out, size_t size)
+{
+    uint8x16_t mask = vdupq_n_u8(key);
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+        vst1q_u8(out + i, veorq_u8(vld1q_u8(in + i), mask));
+    xor_byte_scalar(in + i, key, out + i, size - i);
+}
+#endif
+
+struct Kernels
+{
+    XorStream stream;
+    XorByte byte;
+};
+
+Kernels select_kernels()
+{
+#if defined(L2ENCDEC_X86)
+    if (cpu_features::has_avx2())
+        return {xor_stream_avx2, xor_byte_avx2};
+    if (cpu_features::has_sse2())
+        return {xor_stream_sse2, xor_byte_sse2};
+#elif defined(L2ENCDEC_ARM64)
+    return {xor_stream_neon, xor_byte_neon};
+#endif
+    return {xor_stream_scalar, xor_byte_scalar};
+}
+
+const Kernels &kernels()
+{
+    static const Kernels selected = select_kernels();
+    return selected;
+}
+
+const std::array<unsigned char, KEYSTREAM_PERIOD> &keystream()
+{
+    static const auto table = make_keystream();
+    return table;
+}
+} // namespace
+
+int xor_utils::get_key_by_index(int index)
+{
+    return key_by_index(index);
+}
+
 int xor_utils::get_key_by_filename(std::string filename)
 {
     std::transform(filename.begin(), filename.end(), filename.begin(), ::tolower);
@@ -23,12 +189,8 @@ size_t xor_utils::apply(const std::vector<unsigned char> &input,
                         std::vector<unsigned char> &output,
                         int xor_key)
 {
-    unsigned char key = static_cast<unsigned char>(xor_key);
-
-    output = input;
-    for (auto &byte : output)
-        byte ^= key;
-
+    output.resize(input.size());
+    apply(std::span(input), std::span(output), xor_key);
     return output.size();
 }
 
@@ -37,11 +199,47 @@ size_t xor_utils::apply(const std::vector<unsigned char> &input,
                         int start_index,
                         KeyGenerator key_generator)
 {
+    output.resize(input.size());
+    apply(std::span(input), std::span(output), start_index, key_generator);
+    return output.size();
+}
+
+void xor_utils::apply(std::span<const unsigned char> input,
+                      std::span<unsigned char> output,
+                      int xor_key)
+{
+    kernels().byte(input.data(), static_cast<unsigned char>(xor_key), output.data(), input.size());
+}
+
+void xor_utils::apply(std::span<const unsigned char> input,
+                      std::span<unsigned char> output,
+                      int start_index,
+                      const KeyGenerator &key_generator)
+{
+    if (auto target = key_generator.target<int (*)(int)>(); target && *target == get_key_by_index)
+    {
+        apply_position(input, output, start_index);
+        return;
+    }
+
     int ind = start_index;
 
-    output = input;
-    for (auto &byte : output)
-        byte ^= static_cast<unsigned char>(key_generator(ind++));
+    for (size_t i = 0; i < input.size(); ++i)
+        output[i] = input[i] ^ static_cast<unsigned char>(key_generator(ind++));
+}
 
-    return output.size();
+void xor_utils::apply_position(std::span<const unsigned char> input,
+                               std::span<unsigned char> output,
+                               int start_index)
+{
+    const auto &table = keystream();
+    size_t offset = static_cast<unsigned int>(start_index) % KEYSTREAM_PERIOD;
+
+    for (size_t done = 0; done < input.size();)
+    {
+        size_t size = std::min(input.size() - done, KEYSTREAM_PERIOD - offset);
+        kernels().stream(input.data() + done, table.data() + offset, output.data() + done, size);
+        done += size;
+        offset = 0;
+    }
 }
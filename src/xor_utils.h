@@ -2,6 +2,7 @@
 #define XOR_UTILS_H
 
 #include <functional>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -11,6 +12,11 @@ using KeyGenerator = std::function<int(int)>;
 
 size_t apply(const std::vector<unsigned char> &input, std::vector<unsigned char> &output, int xor_key);
 size_t apply(const std::vector<unsigned char> &input, std::vector<unsigned char> &output, int start_index, KeyGenerator key_generator);
+// `output` must be at least `input.size()` bytes and may alias `input`
+void apply(std::span<const unsigned char> input, std::span<unsigned char> output, int xor_key);
+void apply(std::span<const unsigned char> input, std::span<unsigned char> output, int start_index, const KeyGenerator &key_generator);
+// same as `apply` with `get_key_by_index`, using a precomputed keystream
+void apply_position(std::span<const unsigned char> input, std::span<unsigned char> output, int start_index);
 int get_key_by_index(int index);
 int get_key_by_filename(std::string filename);
 } // namespace xor_utils
@@ -1,109 +1,510 @@
 #include "zlib_utils.h"
+#include "crc32.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <array>
 #include <cstring>
+#include <memory>
 #include <miniz.h>
 
 namespace
 {
 constexpr size_t COMPRESSED_HEADER_SIZE = 4;
-constexpr size_t INFLATE_CHUNK_SIZE = 1024 * 16;
-constexpr size_t DEFLATE_CHUNK_SIZE = 1024 * 1024;
+// a 258-byte match costs at least 2 bits, so one compressed byte yields at most 1032 bytes
+constexpr size_t MAX_DEFLATE_RATIO = 1032;
+constexpr size_t DICTIONARY_SIZE = 32 * 1024;
+constexpr uint32_t ADLER_MOD = 65521;
+// reflected CRC-32 polynomial
+constexpr uint32_t CRC32_POLY = 0xEDB88320;
+
+// deflate with a 32 KiB window
+constexpr unsigned char ZLIB_CMF = 0x78;
+
+// FLEVEL only hints at the level, decoders ignore it
+unsigned char zlib_flags(int level)
+{
+    return level >= 7 ? 0xDA : level == 6 ? 0x9C
+                           : level >= 2   ? 0x5E
+                                          : 0x01;
+}
+
+// Adler-32 of A followed by B, from the checksums of each and the length of B
+uint32_t adler32_combine(uint32_t adler_a, uint32_t adler_b, size_t size_b)
+{
+    uint64_t rem = size_b % ADLER_MOD;
+    uint64_t sum1 = adler_a & 0xFFFF;
+    uint64_t sum2 = rem * sum1 % ADLER_MOD;
+    sum1 += (adler_b & 0xFFFF) + ADLER_MOD - 1;
+    sum2 += (adler_a >> 16) + (adler_b >> 16) + ADLER_MOD - rem;
+    return static_cast<uint32_t>((sum1 % ADLER_MOD) | (sum2 % ADLER_MOD) << 16);
+}
+
+// a * b modulo the CRC-32 polynomial, both reflected
+uint32_t crc32_multiply(uint32_t a, uint32_t b)
+{
+    uint32_t product = 0;
+    for (uint32_t bit = 1u << 31; bit != 0; bit >>= 1)
+    {
+        if (a & bit)
+            product ^= b;
+        b = b & 1 ? (b >> 1) ^ CRC32_POLY : b >> 1;
+    }
+    return product;
+}
+
+// x^(8 * size) modulo the CRC-32 polynomial, by squaring x^8
+uint32_t crc32_shift(size_t size)
+{
+    static const auto powers = []
+    {
+        // powers[k] = x^(2^k), starting from x^1; x^(2^32) is x again
+        std::array<uint32_t, 32> table{};
+        uint32_t power = 1u << 30;
+        for (auto &entry : table)
+        {
+            entry = power;
+            power = crc32_multiply(power, power);
+        }
+        return table;
+    }();
+
+    uint32_t shift = 1u << 31;
+    for (size_t k = 3; size != 0; size >>= 1, ++k)
+        if (size & 1)
+            shift = crc32_multiply(powers[k % powers.size()], shift);
+    return shift;
+}
+
+// size prefix and zlib header that every packed stream starts with
+void emit_prefix(size_t size, int level, const zlib_utils::Sink &sink)
+{
+    uint32_t stored_size = static_cast<uint32_t>(size);
+    unsigned char header[COMPRESSED_HEADER_SIZE + 2];
+    std::memcpy(header, &stored_size, sizeof(stored_size));
+    header[COMPRESSED_HEADER_SIZE] = ZLIB_CMF;
+    header[COMPRESSED_HEADER_SIZE + 1] = zlib_flags(level);
+    sink(header);
+}
+
+void emit_trailer(uint32_t adler, const zlib_utils::Sink &sink)
+{
+    unsigned char trailer[4] = {
+        static_cast<unsigned char>(adler >> 24),
+        static_cast<unsigned char>(adler >> 16),
+        static_cast<unsigned char>(adler >> 8),
+        static_cast<unsigned char>(adler),
+    };
+    sink(trailer);
+}
+
+struct Collector
+{
+    std::vector<unsigned char> *output;
+    bool keep;
+};
+
+mz_bool collect(const void *data, int size, void *user)
+{
+    auto collector = static_cast<Collector *>(user);
+    if (collector->keep)
+    {
+        auto bytes = static_cast<const unsigned char *>(data);
+        collector->output->insert(collector->output->end(), bytes, bytes + size);
+    }
+    return MZ_TRUE;
+}
+
+// raw deflate of `chunk`, ending with the final block if `last` or with a sync flush otherwise
+int deflate_chunk(std::span<const unsigned char> dictionary,
+                  std::span<const unsigned char> chunk,
+                  bool last,
+                  int level,
+                  std::vector<unsigned char> &output)
+{
+    std::unique_ptr<tdefl_compressor, decltype(&tdefl_compressor_free)> compressor(tdefl_compressor_alloc(), tdefl_compressor_free);
+    if (!compressor)
+        return -1;
+
+    Collector collector{&output, false};
+    int flags = static_cast<int>(tdefl_create_comp_flags_from_zip_params(level, -MZ_DEFAULT_WINDOW_BITS, MZ_DEFAULT_STRATEGY));
+    if (tdefl_init(compressor.get(), collect, &collector, flags) != TDEFL_STATUS_OKAY)
+        return -1;
+
+    // miniz cannot preset a dictionary, so compress it and drop the output up to the flush instead
+    if (!dictionary.empty() &&
+        tdefl_compress_buffer(compressor.get(), dictionary.data(), dictionary.size(), TDEFL_SYNC_FLUSH) != TDEFL_STATUS_OKAY)
+        return -1;
+
+    collector.keep = true;
+    tdefl_status status = tdefl_compress_buffer(compressor.get(), chunk.data(), chunk.size(), last ? TDEFL_FINISH : TDEFL_SYNC_FLUSH);
+    return status == (last ? TDEFL_STATUS_DONE : TDEFL_STATUS_OKAY) ? 0 : -1;
+}
 } // namespace
 
-int zlib_utils::unpack(const std::vector<unsigned char> &input_buffer, std::vector<unsigned char> &output_buffer)
+zlib_utils::ChunkedPack::ChunkedPack(std::span<const unsigned char> input, int level, Sink sink)
+    : input_(input),
+      level_(level),
+      sink_(std::move(sink)),
+      chunk_count_(std::max<size_t>((input.size() + PACK_CHUNK_SIZE - 1) / PACK_CHUNK_SIZE, 1)),
+      packed_(chunk_count_),
+      adlers_(chunk_count_),
+      ready_(chunk_count_)
+{
+    if (level < 0 || level > BEST_COMPRESSION || input.size() > UINT32_MAX)
+    {
+        failed_ = true;
+        finished_ = true;
+    }
+}
+
+bool zlib_utils::ChunkedPack::pack_next()
+{
+    size_t index = next_chunk_.fetch_add(1);
+    if (index >= chunk_count_ || failed_.load())
+        return false;
+
+    size_t begin = index * PACK_CHUNK_SIZE;
+    size_t end = std::min(begin + PACK_CHUNK_SIZE, input_.size());
+    size_t dictionary_begin = begin - std::min(begin, DICTIONARY_SIZE);
+    auto chunk = input_.subspan(begin, end - begin);
+
+    std::vector<unsigned char> packed;
+    int rc = deflate_chunk(input_.subspan(dictionary_begin, begin - dictionary_begin), chunk,
+                           index + 1 == chunk_count_, level_, packed);
+    uint32_t adler = static_cast<uint32_t>(mz_adler32(MZ_ADLER32_INIT, chunk.data(), chunk.size()));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (rc != 0)
+    {
+        failed_ = true;
+        finished_ = true;
+        return false;
+    }
+
+    packed_[index] = std::move(packed);
+    adlers_[index] = adler;
+    ready_[index] = true;
+    emit_ready();
+    return true;
+}
+
+void zlib_utils::ChunkedPack::emit_ready()
+{
+    while (!failed_.load() && next_emit_ < chunk_count_ && ready_[next_emit_])
+    {
+        if (next_emit_ == 0)
+            emit_prefix(input_.size(), level_, sink_);
+
+        size_t chunk_size = std::min(PACK_CHUNK_SIZE, input_.size() - next_emit_ * PACK_CHUNK_SIZE);
+        adler_ = adler32_combine(adler_, adlers_[next_emit_], chunk_size);
+        sink_(packed_[next_emit_]);
+        std::vector<unsigned char>().swap(packed_[next_emit_]);
+        ++next_emit_;
+    }
+
+    if (next_emit_ == chunk_count_ && !finished_.load())
+    {
+        emit_trailer(adler_, sink_);
+        finished_ = true;
+    }
+}
+
+zlib_utils::StreamPack::StreamPack(size_t size, int level, Sink sink)
+    : size_(size),
+      level_(level),
+      sink_(std::move(sink)),
+      failed_(level < 0 || level > BEST_COMPRESSION || size > UINT32_MAX)
+{
+}
+
+int zlib_utils::StreamPack::feed(std::span<const unsigned char> input)
 {
-    if (input_buffer.size() < COMPRESSED_HEADER_SIZE)
+    if (failed_ || input.size() > size_ - fed_)
+    {
+        failed_ = true;
         return -1;
+    }
 
-    uint32_t expected_decompressed_size = 0;
-    std::memcpy(&expected_decompressed_size, input_buffer.data(), sizeof(expected_decompressed_size));
+    while (!input.empty())
+    {
+        size_t take = std::min(PACK_CHUNK_SIZE - (window_.size() - dictionary_size_), input.size());
+        window_.insert(window_.end(), input.begin(), input.begin() + take);
+        input = input.subspan(take);
+        fed_ += take;
 
-    tinfl_decompressor decomp;
-    tinfl_init(&decomp);
-    output_buffer.clear();
-    size_t in_pos = COMPRESSED_HEADER_SIZE;
-    size_t out_pos = 0;
+        if (window_.size() - dictionary_size_ == PACK_CHUNK_SIZE && pack_chunk(fed_ == size_) != 0)
+            return -1;
+    }
+
+    return 0;
+}
 
-    while (in_pos < input_buffer.size())
+int zlib_utils::StreamPack::finish()
+{
+    if (failed_ || fed_ != size_)
     {
-        output_buffer.resize(out_pos + INFLATE_CHUNK_SIZE);
-        size_t in_bytes = input_buffer.size() - in_pos;
-        size_t out_bytes = output_buffer.size() - out_pos;
-        tinfl_status status = tinfl_decompress(&decomp,
-                                               input_buffer.data() + in_pos, &in_bytes,
-                                               output_buffer.data(), output_buffer.data() + out_pos, &out_bytes,
-                                               TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF | TINFL_FLAG_PARSE_ZLIB_HEADER);
+        failed_ = true;
+        return -1;
+    }
 
-        in_pos += in_bytes;
-        out_pos += out_bytes;
+    // a partial chunk or empty input is still pending
+    return finished_ ? 0 : pack_chunk(true);
+}
 
-        if (status == TINFL_STATUS_DONE)
+int zlib_utils::StreamPack::pack_chunk(bool last)
+{
+    if (!started_)
+    {
+        emit_prefix(size_, level_, sink_);
+        started_ = true;
+    }
+
+    auto dictionary = std::span(window_).first(dictionary_size_);
+    auto chunk = std::span(window_).subspan(dictionary_size_);
+
+    std::vector<unsigned char> packed;
+    if (deflate_chunk(dictionary, chunk, last, level_, packed) != 0)
+    {
+        failed_ = true;
+        return -1;
+    }
+
+    adler_ = static_cast<uint32_t>(mz_adler32(adler_, chunk.data(), chunk.size()));
+    sink_(packed);
+    if (last)
+    {
+        emit_trailer(adler_, sink_);
+        finished_ = true;
+    }
+
+    size_t keep = std::min(window_.size(), DICTIONARY_SIZE);
+    window_.erase(window_.begin(), window_.end() - keep);
+    dictionary_size_ = keep;
+    return 0;
+}
+
+struct zlib_utils::StreamUnpack::Inflater
+{
+    std::unique_ptr<tinfl_decompressor, decltype(&tinfl_decompressor_free)> decompressor{tinfl_decompressor_alloc(), tinfl_decompressor_free};
+    unsigned char dictionary[TINFL_LZ_DICT_SIZE];
+    size_t dictionary_offset = 0;
+};
+
+zlib_utils::StreamUnpack::StreamUnpack(Sink sink)
+    : sink_(std::move(sink)),
+      inflater_(std::make_unique<Inflater>())
+{
+    failed_ = !inflater_->decompressor;
+}
+
+zlib_utils::StreamUnpack::~StreamUnpack() = default;
+
+int zlib_utils::StreamUnpack::feed(std::span<const unsigned char> input)
+{
+    if (failed_)
+        return -1;
+
+    if (prefix_size_ < COMPRESSED_HEADER_SIZE)
+    {
+        size_t prefix_bytes = std::min(COMPRESSED_HEADER_SIZE - prefix_size_, input.size());
+        std::copy(input.begin(), input.begin() + prefix_bytes, prefix_ + prefix_size_);
+        prefix_size_ += prefix_bytes;
+        input = input.subspan(prefix_bytes);
+        if (prefix_size_ < COMPRESSED_HEADER_SIZE)
+            return 0;
+
+        uint32_t expected_size = 0;
+        std::memcpy(&expected_size, prefix_, sizeof(expected_size));
+        expected_size_ = expected_size;
+    }
+
+    // bytes after the end of the stream are block padding
+    if (done_ || input.empty())
+        return 0;
+
+    return inflate(input, true);
+}
+
+int zlib_utils::StreamUnpack::finish()
+{
+    if (failed_ || prefix_size_ < COMPRESSED_HEADER_SIZE || (!done_ && inflate({}, false) != 0))
+    {
+        failed_ = true;
+        return -1;
+    }
+
+    return done_ && written_ == expected_size_ ? 0 : -1;
+}
+
+int zlib_utils::StreamUnpack::inflate(std::span<const unsigned char> input, bool has_more_input)
+{
+    Inflater &inflater = *inflater_;
+    while (true)
+    {
+        size_t in_bytes = input.size();
+        size_t out_bytes = TINFL_LZ_DICT_SIZE - inflater.dictionary_offset;
+        unsigned char *out = inflater.dictionary + inflater.dictionary_offset;
+        tinfl_status status = tinfl_decompress(inflater.decompressor.get(),
+                                               input.data(), &in_bytes,
+                                               inflater.dictionary, out, &out_bytes,
+                                               TINFL_FLAG_PARSE_ZLIB_HEADER | (has_more_input ? TINFL_FLAG_HAS_MORE_INPUT : 0));
+        input = input.subspan(in_bytes);
+
+        written_ += out_bytes;
+        if (status < TINFL_STATUS_DONE || written_ > expected_size_)
+        {
+            failed_ = true;
+            return -1;
+        }
+
+        if (out_bytes != 0)
         {
-            output_buffer.resize(out_pos);
-            break;
+            sink_(std::span<const unsigned char>(out, out_bytes));
+            inflater.dictionary_offset = (inflater.dictionary_offset + out_bytes) & (TINFL_LZ_DICT_SIZE - 1);
         }
-        else if (status < 0)
+
+        if (status == TINFL_STATUS_DONE)
         {
-            return -1;
+            done_ = true;
+            return 0;
         }
+        if (status == TINFL_STATUS_NEEDS_MORE_INPUT && input.empty())
+            return has_more_input ? 0 : -1;
+    }
+}
+
+int zlib_utils::unpack(const std::vector<unsigned char> &input_buffer, std::vector<unsigned char> &output_buffer)
+{
+    size_t size = 0;
+    if (unpacked_size(input_buffer, size) != 0)
+        return -1;
+
+    output_buffer.resize(size);
+    if (unpack(std::span(input_buffer), std::span(output_buffer)) != 0)
+    {
+        output_buffer.clear();
+        return -1;
     }
 
-    if (out_pos != static_cast<size_t>(expected_decompressed_size))
+    return 0;
+}
+
+int zlib_utils::unpacked_size(std::span<const unsigned char> input_buffer, size_t &size)
+{
+    return unpacked_size(input_buffer, input_buffer.size(), size);
+}
+
+int zlib_utils::unpacked_size(std::span<const unsigned char> input_buffer, size_t packed_size, size_t &size)
+{
+    if (input_buffer.size() < COMPRESSED_HEADER_SIZE || packed_size < COMPRESSED_HEADER_SIZE)
+        return -1;
+
+    uint32_t expected_decompressed_size = 0;
+    std::memcpy(&expected_decompressed_size, input_buffer.data(), sizeof(expected_decompressed_size));
+
+    // deflate cannot expand data more than MAX_DEFLATE_RATIO times, so a larger size is a corrupt or hostile header
+    if (expected_decompressed_size / MAX_DEFLATE_RATIO > packed_size - COMPRESSED_HEADER_SIZE)
         return -1;
 
+    size = expected_decompressed_size;
     return 0;
 }
 
-int zlib_utils::pack(const std::vector<unsigned char> &input_buffer, std::vector<unsigned char> &output_buffer)
+int zlib_utils::unpack(std::span<const unsigned char> input_buffer, std::span<unsigned char> output_buffer)
 {
-    uint32_t uncompressed_size = static_cast<uint32_t>(input_buffer.size());
-    output_buffer.clear();
-    output_buffer.reserve(uncompressed_size);
-    output_buffer.insert(output_buffer.end(),
-                         reinterpret_cast<const unsigned char *>(&uncompressed_size),
-                         reinterpret_cast<const unsigned char *>(&uncompressed_size) + sizeof(uncompressed_size));
-
-    mz_stream stream = {};
-    int status = mz_deflateInit(&stream, MZ_BEST_COMPRESSION);
-    if (status != MZ_OK)
+    size_t expected_size = 0;
+    if (unpacked_size(input_buffer, expected_size) != 0 || expected_size != output_buffer.size())
+        return -1;
+
+    tinfl_decompressor decomp;
+    tinfl_init(&decomp);
+    size_t in_bytes = input_buffer.size() - COMPRESSED_HEADER_SIZE;
+    size_t out_bytes = output_buffer.size();
+    tinfl_status status = tinfl_decompress(&decomp,
+                                           input_buffer.data() + COMPRESSED_HEADER_SIZE, &in_bytes,
+                                           output_buffer.data(), output_buffer.data(), &out_bytes,
+                                           TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF | TINFL_FLAG_PARSE_ZLIB_HEADER);
+
+    if (status != TINFL_STATUS_DONE || out_bytes != output_buffer.size())
         return -1;
 
-    const unsigned char *in = input_buffer.data();
-    std::vector<unsigned char> out(DEFLATE_CHUNK_SIZE);
-    size_t input_pos = 0;
+    return 0;
+}
+
+int zlib_utils::unpack(const Source &source, std::span<unsigned char> output_buffer)
+{
+    unsigned char header[COMPRESSED_HEADER_SIZE];
+    size_t header_pos = 0;
+
+    tinfl_decompressor decomp;
+    tinfl_init(&decomp);
+    size_t out_pos = 0;
+    tinfl_status status = TINFL_STATUS_NEEDS_MORE_INPUT;
 
-    do
+    while (status == TINFL_STATUS_NEEDS_MORE_INPUT)
     {
-        stream.avail_in = static_cast<unsigned int>(std::min(DEFLATE_CHUNK_SIZE, input_buffer.size() - input_pos));
-        stream.next_in = const_cast<unsigned char *>(&in[input_pos]);
+        std::span<const unsigned char> piece = source();
+        bool has_more_input = !piece.empty();
 
-        do
+        if (header_pos < COMPRESSED_HEADER_SIZE)
         {
-            stream.avail_out = DEFLATE_CHUNK_SIZE;
-            stream.next_out = out.data();
-
-            bool is_last_chunk = (input_pos + stream.avail_in == input_buffer.size());
-            status = mz_deflate(&stream, is_last_chunk ? MZ_FINISH : MZ_NO_FLUSH);
-            if (status != MZ_OK && status != MZ_STREAM_END)
+            size_t header_bytes = std::min(COMPRESSED_HEADER_SIZE - header_pos, piece.size());
+            std::copy(piece.begin(), piece.begin() + header_bytes, header + header_pos);
+            header_pos += header_bytes;
+            piece = piece.subspan(header_bytes);
+            if (header_pos < COMPRESSED_HEADER_SIZE)
             {
-                mz_deflateEnd(&stream);
-                return -1;
+                if (!has_more_input)
+                    return -1;
+                continue;
             }
+        }
 
-            int have = DEFLATE_CHUNK_SIZE - stream.avail_out;
-            output_buffer.insert(output_buffer.end(), out.data(), out.data() + have);
-        } while (stream.avail_out == 0);
-
-        input_pos += DEFLATE_CHUNK_SIZE - stream.avail_in;
-    } while (input_pos < input_buffer.size());
+        size_t in_bytes = piece.size();
+        size_t out_bytes = output_buffer.size() - out_pos;
+        status = tinfl_decompress(&decomp,
+                                  piece.data(), &in_bytes,
+                                  output_buffer.data(), output_buffer.data() + out_pos, &out_bytes,
+                                  TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF | TINFL_FLAG_PARSE_ZLIB_HEADER |
+                                      (has_more_input ? TINFL_FLAG_HAS_MORE_INPUT : 0));
+        out_pos += out_bytes;
+    }
 
-    mz_deflateEnd(&stream);
-    if (status != MZ_STREAM_END)
+    uint32_t expected_decompressed_size = 0;
+    std::memcpy(&expected_decompressed_size, header, sizeof(expected_decompressed_size));
+    if (status != TINFL_STATUS_DONE || out_pos != output_buffer.size() || expected_decompressed_size != out_pos)
         return -1;
 
     return 0;
 }
 
-uint32_t zlib_utils::checksum(const std::vector<unsigned char> &buffer, uint32_t checksum)
+int zlib_utils::pack(std::span<const unsigned char> input_buffer, std::vector<unsigned char> &output_buffer, int level)
+{
+    output_buffer.clear();
+    output_buffer.reserve(input_buffer.size());
+    return pack(input_buffer, [&output_buffer](std::span<const unsigned char> chunk)
+                { output_buffer.insert(output_buffer.end(), chunk.begin(), chunk.end()); }, level);
+}
+
+int zlib_utils::pack(std::span<const unsigned char> input_buffer, const Sink &sink, int level)
+{
+    ChunkedPack packer(input_buffer, level, sink);
+    thread_pool::parallel_for(std::min(packer.chunk_count(), thread_pool::concurrency()), 1, [&](size_t, size_t)
+                              { while (packer.pack_next()) {} });
+    return packer.result();
+}
+
+size_t zlib_utils::pack_bound(size_t size)
+{
+    return COMPRESSED_HEADER_SIZE + mz_compressBound(static_cast<mz_ulong>(size));
+}
+
+uint32_t zlib_utils::checksum(std::span<const unsigned char> buffer, uint32_t checksum)
+{
+    return crc32::update(checksum, buffer);
+}
+
+uint32_t zlib_utils::checksum_combine(uint32_t checksum_a, uint32_t checksum_b, size_t size_b)
 {
-    return mz_crc32(checksum, buffer.data(), buffer.size());
+    return crc32_multiply(crc32_shift(size_b), checksum_a) ^ checksum_b;
 }
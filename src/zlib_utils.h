@@ -1,14 +1,137 @@
 #ifndef ZLIB_UTILS_H
 #define ZLIB_UTILS_H
 
+#include <cstddef>
 #include <cstdint>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
 #include <vector>
 
 namespace zlib_utils
 {
+// receives packed output in order, starting with the size prefix
+using Sink = std::function<void(std::span<const unsigned char> chunk)>;
+// yields the next piece of packed data, starting with the size prefix; an empty span ends the input
+using Source = std::function<std::span<const unsigned char>()>;
+
+constexpr int BEST_SPEED = 1;
+constexpr int BEST_COMPRESSION = 9;
+// input bytes per independently deflated chunk of `pack`
+constexpr size_t PACK_CHUNK_SIZE = 256 * 1024;
+
+// pigz-style deflate: every chunk is primed with the 32 KiB before it and ends on a byte boundary with a sync flush,
+// so chunks compress on any thread and still concatenate into one zlib stream
+class ChunkedPack
+{
+public:
+    // `sink` is called in order and never concurrently, from whichever thread completes the next chunk
+    ChunkedPack(std::span<const unsigned char> input, int level, Sink sink);
+
+    size_t chunk_count() const { return chunk_count_; }
+    // compresses the next unclaimed chunk and passes on whatever is now in order; false once none are left
+    bool pack_next();
+    // true once the whole stream went through the sink, or packing failed
+    bool finished() const { return finished_.load(); }
+    // 0 on success, valid once finished
+    int result() const { return failed_.load() ? -1 : 0; }
+
+private:
+    void emit_ready();
+
+    std::span<const unsigned char> input_;
+    int level_;
+    Sink sink_;
+    size_t chunk_count_;
+    std::atomic<size_t> next_chunk_{0};
+    std::atomic<bool> finished_{false};
+    std::atomic<bool> failed_{false};
+
+    // guards everything below and serializes the sink
+    std::mutex mutex_;
+    std::vector<std::vector<unsigned char>> packed_;
+    std::vector<uint32_t> adlers_;
+    std::vector<bool> ready_;
+    size_t next_emit_ = 0;
+    uint32_t adler_ = 1;
+};
+
+// serial ChunkedPack for input that arrives in pieces, producing the same stream as `pack`
+class StreamPack
+{
+public:
+    // `size` is the total input, which the prefix stores before any of it is seen
+    StreamPack(size_t size, int level, Sink sink);
+
+    int feed(std::span<const unsigned char> input);
+    // fails unless exactly `size` bytes were fed
+    int finish();
+
+private:
+    int pack_chunk(bool last);
+
+    size_t size_;
+    int level_;
+    Sink sink_;
+    // up to 32 KiB of dictionary, followed by the chunk still being filled
+    std::vector<unsigned char> window_;
+    size_t dictionary_size_ = 0;
+    size_t fed_ = 0;
+    uint32_t adler_ = 1;
+    bool started_ = false;
+    bool finished_ = false;
+    bool failed_ = false;
+};
+
+// inflates packed data that arrives in pieces, passing the output on through a 32 KiB window
+class StreamUnpack
+{
+public:
+    explicit StreamUnpack(Sink sink);
+    ~StreamUnpack();
+
+    StreamUnpack(const StreamUnpack &) = delete;
+    StreamUnpack &operator=(const StreamUnpack &) = delete;
+
+    int feed(std::span<const unsigned char> input);
+    // fails unless the stream ended with as many bytes as its prefix stores
+    int finish();
+
+private:
+    struct Inflater;
+
+    int inflate(std::span<const unsigned char> input, bool has_more_input);
+
+    Sink sink_;
+    std::unique_ptr<Inflater> inflater_;
+    unsigned char prefix_[4] = {};
+    size_t prefix_size_ = 0;
+    size_t expected_size_ = 0;
+    size_t written_ = 0;
+    bool done_ = false;
+    bool failed_ = false;
+};
+
 int unpack(const std::vector<unsigned char> &input_buffer, std::vector<unsigned char> &output_buffer);
-int pack(const std::vector<unsigned char> &input_buffer, std::vector<unsigned char> &output_buffer);
-uint32_t checksum(const std::vector<unsigned char> &buffer, uint32_t checksum = 0);
+
+// `level` ranges from 0 (stored) to BEST_COMPRESSION
+int pack(std::span<const unsigned char> input_buffer, std::vector<unsigned char> &output_buffer, int level = BEST_COMPRESSION);
+// packs chunks on the shared thread pool
+int pack(std::span<const unsigned char> input_buffer, const Sink &sink, int level = BEST_COMPRESSION);
+// reads the uncompressed size stored in front of the zlib stream; fails if the stream is too short to produce it
+int unpacked_size(std::span<const unsigned char> input_buffer, size_t &size);
+// for when `input_buffer` is only the beginning of `packed_size` bytes of packed data
+int unpacked_size(std::span<const unsigned char> input_buffer, size_t packed_size, size_t &size);
+// `output_buffer` must be exactly `unpacked_size` bytes
+int unpack(std::span<const unsigned char> input_buffer, std::span<unsigned char> output_buffer);
+int unpack(const Source &source, std::span<unsigned char> output_buffer);
+// upper bound of `pack` output for `size` input bytes
+size_t pack_bound(size_t size);
+uint32_t checksum(std::span<const unsigned char> buffer, uint32_t checksum = 0);
+// CRC-32 of A followed by B, from the checksums of each and the length of B
+uint32_t checksum_combine(uint32_t checksum_a, uint32_t checksum_b, size_t size_b);
 } // namespace zlib_utils
 
 #endif // ZLIB_UTILS_H
@@ -1,4 +1,8 @@
 #include "blowfish.h"
+#include <algorithm>
+#include <blowfish/blowfish.h>
+#include <cstdint>
+#include <cstring>
 #include <gtest/gtest.h>
 #include <string>
 #include <vector>
@@ -17,3 +21,113 @@ TEST(BFEncryptDecrypt, EncryptDecryptRoundTrip)
     ASSERT_EQ(dec_size, dec.size());
     EXPECT_EQ(dec, input);
 }
+
+TEST(BFEncryptDecrypt, InPlaceKeepsPartialBlock)
+{
+    std::string key = "testkey";
+    std::vector<unsigned char> input = {'D', 'A', 'T', 'A', '1', '2', '3', '4', 'x', 'y', 'z'};
+    std::vector<unsigned char> data = input, expected;
+
+    blowfish::encrypt(input, expected, key);
+    blowfish::encrypt(std::span<const unsigned char>(data), std::span(data), *blowfish::load_key(key));
+    EXPECT_EQ(data, expected);
+    EXPECT_EQ(data[8], 'x');
+
+    blowfish::decrypt(std::span<const unsigned char>(data), std::span(data), *blowfish::load_key(key));
+    EXPECT_EQ(data, input);
+}
+
+TEST(BFKnownAnswer, SchneierVectors)
+{
+    // key, plaintext and ciphertext as big-endian words; the module reads words little-endian
+    struct Vector
+    {
+        uint64_t key, plain, cipher;
+    };
+    const Vector vectors[] = {
+        {0x0000000000000000, 0x0000000000000000, 0x4EF997456198DD78},
+        {0x3000000000000000, 0x1000000000000001, 0x7D856F9A613063F2},
+    };
+
+    auto to_bytes = [](uint64_t v)
+    {
+        std::vector<unsigned char> bytes;
+        for (int word = 1; word >= 0; --word)
+            for (int b = 0; b < 4; ++b)
+                bytes.push_back(static_cast<unsigned char>(v >> (32 * word + 8 * b)));
+        return bytes;
+    };
+
+    for (const auto &v : vectors)
+    {
+        std::string key;
+        for (int b = 7; b >= 0; --b)
+            key.push_back(static_cast<char>(v.key >> (8 * b)));
+
+        std::vector<unsigned char> enc;
+        blowfish::encrypt(to_bytes(v.plain), enc, key);
+        EXPECT_EQ(enc, to_bytes(v.cipher));
+    }
+}
+
+TEST(BFKnownAnswer, MatchesReferenceImplementation)
+{
+    std::vector<unsigned char> input(8 * 37 + 5);
+    for (size_t i = 0; i < input.size(); ++i)
+        input[i] = static_cast<unsigned char>(i * 29 + 11);
+
+    for (std::string key : {"31==-%&@!^+][;'.]94-", "[;'.]94-&@%!^+]-31==", "k"})
+    {
+        std::vector<unsigned char> expected = input;
+        Blowfish reference(key + '\0');
+        for (size_t i = 0; i + 8 <= expected.size(); i += 8)
+        {
+            uint32_t l, r;
+            std::memcpy(&l, &expected[i], 4);
+            std::memcpy(&r, &expected[i + 4], 4);
+            reference.encrypt(l, r);
+            std::memcpy(&expected[i], &l, 4);
+            std::memcpy(&expected[i + 4], &r, 4);
+        }
+
+        std::vector<unsigned char> enc, dec;
+        blowfish::encrypt(input, enc, key);
+        EXPECT_EQ(enc, expected);
+
+        blowfish::decrypt(enc, dec, key);
+        EXPECT_EQ(dec, input);
+    }
+}
+
+TEST(BFEncryptDecrypt, ParallelMatchesChunked)
+{
+    std::string key = "31==-%&@!^+][;'.]94-";
+    std::vector<unsigned char> input(3 * 1024 * 1024 + 13);
+    for (size_t i = 0; i < input.size(); ++i)
+        input[i] = static_cast<unsigned char>(i * 7 + (i >> 12));
+
+    std::vector<unsigned char> enc, dec;
+    blowfish::encrypt(input, enc, key);
+
+    constexpr size_t CHUNK = 64 * 1024;
+    for (size_t offset = 0; offset < input.size(); offset += CHUNK)
+    {
+        size_t size = std::min(CHUNK, input.size() - offset);
+        std::vector<unsigned char> chunk(input.begin() + offset, input.begin() + offset + size), chunk_enc;
+        blowfish::encrypt(chunk, chunk_enc, key);
+        ASSERT_TRUE(std::equal(chunk_enc.begin(), chunk_enc.end(), enc.begin() + offset)) << "offset " << offset;
+    }
+
+    blowfish::decrypt(enc, dec, key);
+    EXPECT_EQ(dec, input);
+}
+
+TEST(BFKey, LoadKeyIsCached)
+{
+    auto first = blowfish::load_key("31==-%&@!^+][;'.]94-");
+    auto second = blowfish::load_key("31==-%&@!^+][;'.]94-");
+    auto other = blowfish::load_key("[;'.]94-&@%!^+]-31==");
+    ASSERT_NE(first, nullptr);
+    EXPECT_EQ(first, second);
+    EXPECT_NE(first, other);
+}
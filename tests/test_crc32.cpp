@@ -0,0 +1,63 @@
+#include "crc32.h"
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+static uint32_t bitwise_crc32(std::span<const unsigned char> data)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    for (unsigned char byte : data)
+    {
+        crc ^= byte;
+        for (int bit = 0; bit < 8; ++bit)
+            crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+    }
+    return ~crc;
+}
+
+TEST(Crc32, KnownValue)
+{
+    std::string check = "123456789";
+    auto data = std::span(reinterpret_cast<const unsigned char *>(check.data()), check.size());
+    EXPECT_EQ(crc32::update(0, data), 0xCBF43926u);
+    EXPECT_EQ(crc32::update_portable(0, data), 0xCBF43926u);
+    EXPECT_EQ(crc32::update(0, {}), 0u);
+}
+
+TEST(Crc32, KernelMatchesBitwise)
+{
+    std::vector<unsigned char> buffer(4096 + 16);
+    for (size_t i = 0; i < buffer.size(); ++i)
+        buffer[i] = static_cast<unsigned char>((i * 131) ^ (i >> 3));
+
+    SCOPED_TRACE(crc32::kernel_name());
+    // every alignment, and lengths around the 16 and 64 byte folding steps
+    for (size_t offset = 0; offset < 16; ++offset)
+        for (size_t size = 0; size <= 300; ++size)
+        {
+            auto data = std::span(buffer).subspan(offset, size);
+            uint32_t expected = bitwise_crc32(data);
+            ASSERT_EQ(crc32::update(0, data), expected) << offset << " " << size;
+            ASSERT_EQ(crc32::update_portable(0, data), expected) << offset << " " << size;
+        }
+
+    auto whole = std::span(buffer).first(4096);
+    EXPECT_EQ(crc32::update(0, whole), bitwise_crc32(whole));
+}
+
+TEST(Crc32, ContinuesAcrossPieces)
+{
+    std::vector<unsigned char> buffer(10000);
+    for (size_t i = 0; i < buffer.size(); ++i)
+        buffer[i] = static_cast<unsigned char>(i * 7);
+
+    uint32_t whole = crc32::update(0, buffer);
+    for (size_t split : {size_t(1), size_t(63), size_t(64), size_t(4099)})
+    {
+        auto first = std::span(buffer).first(split);
+        auto rest = std::span(buffer).subspan(split);
+        EXPECT_EQ(crc32::update(crc32::update(0, first), rest), whole) << split;
+        EXPECT_EQ(crc32::update_portable(crc32::update(0, first), rest), whole) << split;
+    }
+}
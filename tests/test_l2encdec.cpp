@@ -1,5 +1,10 @@
+#include <algorithm>
+#include <cstddef>
 #include <gtest/gtest.h>
 #include <l2encdec.h>
+#include <memory_resource>
+#include <span>
+#include <thread>
 
 static std::vector<unsigned char> make_input()
 {
@@ -76,6 +81,46 @@ TEST(L2EncodeDecode, RSA)
     EXPECT_EQ(dec, input);
 }
 
+TEST(L2EncodeDecode, RSAFastCompression)
+{
+    auto input = make_input();
+    std::vector<unsigned char> enc, dec;
+    l2encdec::Params params;
+    ASSERT_TRUE(l2encdec::init_params(params, 413));
+    params.compression_level = 1;
+
+    ASSERT_EQ(l2encdec::encode(input, enc, params), l2encdec::EncodeResult::SUCCESS);
+    ASSERT_EQ(l2encdec::decode(enc, dec, params), l2encdec::DecodeResult::SUCCESS);
+    EXPECT_EQ(dec, input);
+
+    params.compression_level = 10;
+    EXPECT_EQ(l2encdec::encode(input, enc, params), l2encdec::EncodeResult::COMPRESSION_FAILED);
+}
+
+TEST(L2EncodeDecode, RSABatch)
+{
+    std::vector<std::vector<unsigned char>> inputs = {make_input(), std::vector<unsigned char>(1000, 'x'), {'A'}};
+    std::vector<std::vector<unsigned char>> outputs;
+    l2encdec::Params params;
+    ASSERT_TRUE(l2encdec::init_params(params, 413));
+
+    ASSERT_EQ(l2encdec::encode_batch(inputs, outputs, params),
+              l2encdec::EncodeResult::SUCCESS);
+    ASSERT_EQ(outputs.size(), inputs.size());
+
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        std::vector<unsigned char> single, dec;
+        ASSERT_EQ(l2encdec::encode(inputs[i], single, params),
+                  l2encdec::EncodeResult::SUCCESS);
+        EXPECT_EQ(outputs[i], single);
+
+        ASSERT_EQ(l2encdec::decode(outputs[i], dec, params),
+                  l2encdec::DecodeResult::SUCCESS);
+        EXPECT_EQ(dec, inputs[i]);
+    }
+}
+
 TEST(L2Encode, HeaderAndTailApplied)
 {
     auto input = make_input();
@@ -117,3 +162,374 @@ TEST(L2DecodeFail, TooSmallInput)
     EXPECT_EQ(l2encdec::decode(input, out, 111, "", false),
               l2encdec::DecodeResult::INVALID_TYPE);
 }
+
+TEST(L2EncodeDecode, SpanMatchesVector)
+{
+    std::vector<unsigned char> input(1000);
+    for (size_t i = 0; i < input.size(); ++i)
+        input[i] = static_cast<unsigned char>(i * 7 + 3);
+
+    for (int protocol : {111, 120, 121, 211, 413})
+    {
+        SCOPED_TRACE(protocol);
+        l2encdec::Params params;
+        ASSERT_TRUE(l2encdec::init_params(params, protocol, "file.txt"));
+
+        std::vector<unsigned char> enc;
+        ASSERT_EQ(l2encdec::encode(input, enc, params), l2encdec::EncodeResult::SUCCESS);
+
+        std::vector<std::byte> span_enc(l2encdec::encoded_size_bound(input.size(), params));
+        size_t written = 0;
+        ASSERT_EQ(l2encdec::encode(std::as_bytes(std::span(input)), span_enc, written, params),
+                  l2encdec::EncodeResult::SUCCESS);
+        ASSERT_EQ(written, enc.size());
+        EXPECT_TRUE(std::equal(enc.begin(), enc.end(), reinterpret_cast<const unsigned char *>(span_enc.data())));
+
+        size_t size = 0;
+        ASSERT_EQ(l2encdec::decoded_size(std::as_bytes(std::span(enc)), size, params),
+                  l2encdec::DecodeResult::SUCCESS);
+        ASSERT_EQ(size, input.size());
+
+        std::vector<std::byte> dec(size);
+        ASSERT_EQ(l2encdec::decode(std::as_bytes(std::span(enc)), dec, written, params),
+                  l2encdec::DecodeResult::SUCCESS);
+        ASSERT_EQ(written, input.size());
+        EXPECT_TRUE(std::equal(input.begin(), input.end(), reinterpret_cast<const unsigned char *>(dec.data())));
+    }
+}
+
+TEST(L2EncodeDecode, VerifyWhileDecoding)
+{
+    // several slices per task, and a partial Blowfish block at the end
+    std::vector<unsigned char> input(1000003);
+    for (size_t i = 0; i < input.size(); ++i)
+        input[i] = static_cast<unsigned char>((i * i) >> 11);
+
+    for (int protocol : {111, 120, 121, 211, 413})
+    {
+        SCOPED_TRACE(protocol);
+        l2encdec::Params params;
+        ASSERT_TRUE(l2encdec::init_params(params, protocol, "file.txt"));
+
+        std::vector<unsigned char> enc;
+        ASSERT_EQ(l2encdec::encode(input, enc, params), l2encdec::EncodeResult::SUCCESS);
+        ASSERT_EQ(l2encdec::verify_checksum(enc), l2encdec::ChecksumResult::SUCCESS);
+
+        std::vector<std::byte> dec(input.size());
+        size_t written = 0;
+        auto checksum = l2encdec::ChecksumResult::MISMATCH;
+        ASSERT_EQ(l2encdec::decode(std::as_bytes(std::span(enc)), dec, written, checksum, params),
+                  l2encdec::DecodeResult::SUCCESS);
+        EXPECT_EQ(checksum, l2encdec::ChecksumResult::SUCCESS);
+        ASSERT_EQ(written, input.size());
+        EXPECT_TRUE(std::equal(input.begin(), input.end(), reinterpret_cast<const unsigned char *>(dec.data())));
+
+        if (protocol == 413)
+            continue;
+        enc[enc.size() / 2] ^= 0x01;
+        ASSERT_EQ(l2encdec::decode(std::as_bytes(std::span(enc)), dec, written, checksum, params),
+                  l2encdec::DecodeResult::SUCCESS);
+        EXPECT_EQ(checksum, l2encdec::ChecksumResult::MISMATCH);
+    }
+}
+
+TEST(L2EncodeDecode, SpanBufferTooSmall)
+{
+    auto input = make_input();
+    std::vector<unsigned char> enc;
+    ASSERT_EQ(l2encdec::encode(input, enc, 413), l2encdec::EncodeResult::SUCCESS);
+
+    l2encdec::Params params;
+    ASSERT_TRUE(l2encdec::init_params(params, 413));
+
+    std::vector<std::byte> small(input.size() - 1);
+    size_t written = 0;
+    EXPECT_EQ(l2encdec::decode(std::as_bytes(std::span(enc)), small, written, params),
+              l2encdec::DecodeResult::BUFFER_TOO_SMALL);
+    EXPECT_EQ(written, input.size());
+
+    EXPECT_EQ(l2encdec::encode(std::as_bytes(std::span(input)), small, written, params),
+              l2encdec::EncodeResult::BUFFER_TOO_SMALL);
+    EXPECT_EQ(written, enc.size());
+}
+
+TEST(L2EncodeDecode, InPlaceMatchesVector)
+{
+    std::vector<unsigned char> input(1001);
+    for (size_t i = 0; i < input.size(); ++i)
+        input[i] = static_cast<unsigned char>(i * 11 + 5);
+
+    for (int protocol : {111, 120, 121, 211, 212})
+    {
+        SCOPED_TRACE(protocol);
+        l2encdec::Params params;
+        ASSERT_TRUE(l2encdec::init_params(params, protocol, "file.txt"));
+
+        std::vector<unsigned char> enc;
+        ASSERT_EQ(l2encdec::encode(input, enc, params), l2encdec::EncodeResult::SUCCESS);
+
+        std::vector<unsigned char> buffer(l2encdec::encoded_size_bound(input.size(), params));
+        std::copy(input.begin(), input.end(), buffer.begin());
+        size_t written = 0;
+        ASSERT_EQ(l2encdec::encode_inplace(std::as_writable_bytes(std::span(buffer)), input.size(), written, params),
+                  l2encdec::EncodeResult::SUCCESS);
+        ASSERT_EQ(written, buffer.size());
+        EXPECT_EQ(buffer, enc);
+
+        std::span<std::byte> payload;
+        ASSERT_EQ(l2encdec::decode_inplace(std::as_writable_bytes(std::span(buffer)), payload, params),
+                  l2encdec::DecodeResult::SUCCESS);
+        ASSERT_EQ(payload.size(), input.size());
+        EXPECT_TRUE(std::equal(input.begin(), input.end(), reinterpret_cast<const unsigned char *>(payload.data())));
+    }
+}
+
+TEST(L2EncodeDecode, InPlaceRejectsRSA)
+{
+    l2encdec::Params params;
+    ASSERT_TRUE(l2encdec::init_params(params, 413));
+
+    std::vector<std::byte> buffer(256);
+    std::span<std::byte> payload;
+    size_t written = 0;
+    EXPECT_EQ(l2encdec::encode_inplace(buffer, 10, written, params), l2encdec::EncodeResult::INVALID_TYPE);
+    EXPECT_EQ(l2encdec::decode_inplace(buffer, payload, params), l2encdec::DecodeResult::INVALID_TYPE);
+}
+
+TEST(L2EncodeDecode, RSADecodedSizeOfLargeFile)
+{
+    std::vector<unsigned char> input(4 * 1024 * 1024, 'a');
+    std::vector<unsigned char> enc;
+    l2encdec::Params params;
+    ASSERT_TRUE(l2encdec::init_params(params, 413));
+    ASSERT_EQ(l2encdec::encode(input, enc, params), l2encdec::EncodeResult::SUCCESS);
+
+    size_t size = 0;
+    ASSERT_EQ(l2encdec::decoded_size(std::as_bytes(std::span(enc)), size, params),
+              l2encdec::DecodeResult::SUCCESS);
+    EXPECT_EQ(size, input.size());
+}
+
+TEST(L2EncodeDecode, Stats)
+{
+    std::vector<unsigned char> input(300000);
+    for (size_t i = 0; i < input.size(); ++i)
+        input[i] = static_cast<unsigned char>((i * i) >> 9);
+
+    for (int protocol : {111, 121, 413})
+    {
+        SCOPED_TRACE(protocol);
+        l2encdec::Params params;
+        ASSERT_TRUE(l2encdec::init_params(params, protocol, "file.txt"));
+        std::vector<unsigned char> enc, dec;
+
+        l2encdec::Stats encoding;
+        params.stats = &encoding;
+        ASSERT_EQ(l2encdec::encode(input, enc, params), l2encdec::EncodeResult::SUCCESS);
+        EXPECT_EQ(encoding.bytes_in, input.size());
+        EXPECT_EQ(encoding.bytes_out, enc.size());
+        EXPECT_GT(encoding.total.count(), 0);
+        EXPECT_GT(encoding.checksum.count(), 0);
+        EXPECT_GE(encoding.threads, 1u);
+        EXPECT_GE(encoding.allocations, 1u);
+        EXPECT_GE(encoding.peak_buffer_size, enc.size());
+
+        l2encdec::Stats decoding;
+        params.stats = &decoding;
+        ASSERT_EQ(l2encdec::decode(enc, dec, params), l2encdec::DecodeResult::SUCCESS);
+        ASSERT_EQ(dec, input);
+        EXPECT_EQ(decoding.bytes_in, enc.size());
+        EXPECT_EQ(decoding.bytes_out, input.size());
+
+        if (protocol == 413)
+        {
+            EXPECT_GT(encoding.deflate.count(), 0);
+            EXPECT_GT(encoding.rsa.count(), 0);
+            EXPECT_GT(decoding.inflate.count(), 0);
+            EXPECT_GT(decoding.padding.count(), 0);
+            EXPECT_EQ(encoding.rsa_blocks, (enc.size() - 28 - 20) / 128);
+            EXPECT_EQ(decoding.rsa_blocks, encoding.rsa_blocks + 1);
+        }
+        else
+        {
+            EXPECT_GT(encoding.transform.count(), 0);
+            EXPECT_GT(decoding.transform.count(), 0);
+            EXPECT_EQ(encoding.rsa_blocks, 0u);
+        }
+
+        // a second call adds to the same totals
+        ASSERT_EQ(l2encdec::decode(enc, dec, params), l2encdec::DecodeResult::SUCCESS);
+        EXPECT_EQ(decoding.bytes_in, 2 * enc.size());
+    }
+}
+
+TEST(L2Codec, MatchesFreeFunctions)
+{
+    std::vector<unsigned char> input(100003);
+    for (size_t i = 0; i < input.size(); ++i)
+        input[i] = static_cast<unsigned char>((i * i) >> 9);
+
+    for (int protocol : {111, 120, 121, 211, 212, 413})
+    {
+        SCOPED_TRACE(protocol);
+        l2encdec::Params params;
+        ASSERT_TRUE(l2encdec::init_params(params, protocol, "file.txt"));
+        l2encdec::Codec codec(protocol, "file.txt");
+        ASSERT_TRUE(codec.is_valid());
+        EXPECT_EQ(codec.params().type, params.type);
+
+        std::vector<unsigned char> expected, enc, dec;
+        ASSERT_EQ(l2encdec::encode(input, expected, params), l2encdec::EncodeResult::SUCCESS);
+        ASSERT_EQ(codec.encode(input, enc), l2encdec::EncodeResult::SUCCESS);
+        EXPECT_EQ(enc, expected);
+        ASSERT_EQ(codec.decode(enc, dec), l2encdec::DecodeResult::SUCCESS);
+        EXPECT_EQ(dec, input);
+
+        std::vector<std::byte> buffer(codec.encoded_size_bound(input.size()));
+        EXPECT_EQ(buffer.size(), l2encdec::encoded_size_bound(input.size(), params));
+        size_t written = 0;
+        ASSERT_EQ(codec.encode(std::as_bytes(std::span(input)), buffer, written), l2encdec::EncodeResult::SUCCESS);
+        ASSERT_EQ(written, enc.size());
+        EXPECT_TRUE(std::equal(enc.begin(), enc.end(), reinterpret_cast<const unsigned char *>(buffer.data())));
+
+        size_t size = 0;
+        ASSERT_EQ(codec.decoded_size(std::as_bytes(std::span(enc)), size), l2encdec::DecodeResult::SUCCESS);
+        ASSERT_EQ(size, input.size());
+        auto checksum = l2encdec::ChecksumResult::MISMATCH;
+        ASSERT_EQ(codec.decode(std::as_bytes(std::span(enc)), buffer, written, checksum), l2encdec::DecodeResult::SUCCESS);
+        EXPECT_EQ(written, input.size());
+        EXPECT_EQ(checksum, l2encdec::ChecksumResult::SUCCESS);
+        EXPECT_TRUE(std::equal(input.begin(), input.end(), reinterpret_cast<const unsigned char *>(buffer.data())));
+    }
+}
+
+TEST(L2Codec, CustomHeaderAndTail)
+{
+    std::vector<unsigned char> input(5000, 'x');
+    l2encdec::Params params;
+    ASSERT_TRUE(l2encdec::init_params(params, 211));
+    params.header = "Custom";
+    params.tail = "ABCDEF01";
+
+    std::vector<unsigned char> expected, enc, dec;
+    ASSERT_EQ(l2encdec::encode(input, expected, params), l2encdec::EncodeResult::SUCCESS);
+    l2encdec::Codec codec(params);
+    ASSERT_EQ(codec.encode(input, enc), l2encdec::EncodeResult::SUCCESS);
+    EXPECT_EQ(enc, expected);
+
+    std::vector<std::byte> buffer(codec.encoded_size_bound(input.size()));
+    std::copy(input.begin(), input.end(), reinterpret_cast<unsigned char *>(buffer.data()));
+    size_t written = 0;
+    ASSERT_EQ(codec.encode_inplace(buffer, input.size(), written), l2encdec::EncodeResult::SUCCESS);
+    ASSERT_EQ(written, enc.size());
+    EXPECT_TRUE(std::equal(enc.begin(), enc.end(), reinterpret_cast<const unsigned char *>(buffer.data())));
+
+    std::span<std::byte> payload;
+    ASSERT_EQ(codec.decode_inplace(buffer, payload), l2encdec::DecodeResult::SUCCESS);
+    ASSERT_EQ(payload.size(), input.size());
+    EXPECT_TRUE(std::equal(input.begin(), input.end(), reinterpret_cast<const unsigned char *>(payload.data())));
+}
+
+TEST(L2Codec, UnknownProtocol)
+{
+    l2encdec::Codec unknown(999);
+    l2encdec::Codec without_filename(121);
+    std::vector<unsigned char> input(10), output;
+    for (const auto &codec : {unknown, without_filename})
+    {
+        EXPECT_FALSE(codec.is_valid());
+        EXPECT_EQ(codec.encode(input, output), l2encdec::EncodeResult::INVALID_TYPE);
+        EXPECT_EQ(codec.decode(input, output), l2encdec::DecodeResult::INVALID_TYPE);
+    }
+}
+
+TEST(L2Codec, SharedBetweenThreads)
+{
+    const l2encdec::Codec codec(211);
+    std::vector<std::thread> threads;
+    std::vector<int> failures(4);
+    for (size_t t = 0; t < failures.size(); ++t)
+        threads.emplace_back([&, t]()
+                             {
+            for (size_t size = 0; size < 3000; size += 37)
+            {
+                std::vector<unsigned char> input(size, static_cast<unsigned char>(t + size)), enc, dec;
+                if (codec.encode(input, enc) != l2encdec::EncodeResult::SUCCESS ||
+                    codec.decode(enc, dec) != l2encdec::DecodeResult::SUCCESS || dec != input)
+                    ++failures[t];
+            } });
+    for (auto &thread : threads)
+        thread.join();
+
+    for (int failed : failures)
+        EXPECT_EQ(failed, 0);
+}
+
+namespace
+{
+class CountingResource : public std::pmr::memory_resource
+{
+public:
+    size_t allocations = 0;
+    size_t outstanding = 0;
+
+private:
+    void *do_allocate(size_t bytes, size_t alignment) override
+    {
+        ++allocations;
+        ++outstanding;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void *p, size_t bytes, size_t alignment) override
+    {
+        --outstanding;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+} // namespace
+
+TEST(L2EncodeDecode, RSAScratchFromMemoryResource)
+{
+    std::vector<unsigned char> input(200000);
+    for (size_t i = 0; i < input.size(); ++i)
+        input[i] = static_cast<unsigned char>((i * i) >> 9);
+
+    CountingResource resource;
+    l2encdec::Params params;
+    ASSERT_TRUE(l2encdec::init_params(params, 413));
+    params.memory_resource = &resource;
+
+    std::vector<unsigned char> enc, dec;
+    ASSERT_EQ(l2encdec::encode(input, enc, params), l2encdec::EncodeResult::SUCCESS);
+    EXPECT_GE(resource.allocations, 1u);
+    ASSERT_EQ(l2encdec::decode(enc, dec, params), l2encdec::DecodeResult::SUCCESS);
+    EXPECT_EQ(dec, input);
+    EXPECT_GE(resource.allocations, 2u);
+    EXPECT_EQ(resource.outstanding, 0u);
+
+    std::vector<unsigned char> expected;
+    params.memory_resource = l2encdec::huge_page_resource();
+    ASSERT_EQ(l2encdec::encode(input, expected, params), l2encdec::EncodeResult::SUCCESS);
+    EXPECT_EQ(expected, enc);
+}
+
+TEST(L2EncodeDecode, HugePageResource)
+{
+    auto resource = l2encdec::huge_page_resource();
+    for (size_t size : {size_t(100), size_t(2) << 20, (size_t(5) << 20) + 3})
+    {
+        auto data = static_cast<unsigned char *>(resource->allocate(size));
+        ASSERT_NE(data, nullptr);
+        data[0] = 1;
+        data[size - 1] = 2;
+        EXPECT_EQ(data[0] + data[size - 1], 3);
+        resource->deallocate(data, size);
+    }
+    EXPECT_TRUE(resource->is_equal(*l2encdec::huge_page_resource()));
+}
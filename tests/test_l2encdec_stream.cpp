@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <cstddef>
+#include <gtest/gtest.h>
+#include <l2encdec.h>
+#include <span>
+
+static std::vector<unsigned char> make_input(size_t size)
+{
+    std::vector<unsigned char> input(size);
+    for (size_t i = 0; i < input.size(); ++i)
+        input[i] = static_cast<unsigned char>((i * i) >> 9);
+    return input;
+}
+
+static l2encdec::Writer append_to(std::vector<unsigned char> &output)
+{
+    return [&output](std::span<const std::byte> data)
+    {
+        auto bytes = reinterpret_cast<const unsigned char *>(data.data());
+        output.insert(output.end(), bytes, bytes + data.size());
+    };
+}
+
+template <typename Codec>
+static auto feed_in_pieces(Codec &codec, std::span<const unsigned char> input, size_t piece)
+{
+    for (size_t pos = 0; pos < input.size(); pos += piece)
+    {
+        auto result = codec.feed(std::as_bytes(input.subspan(pos, std::min(piece, input.size() - pos))));
+        if (result != decltype(result)::SUCCESS)
+            return result;
+    }
+    return codec.finish();
+}
+
+TEST(L2Stream, MatchesOneShot)
+{
+    auto input = make_input(300000);
+
+    for (int protocol : {111, 120, 121, 211, 212, 413})
+    {
+        l2encdec::Params params;
+        ASSERT_TRUE(l2encdec::init_params(params, protocol, "file.txt"));
+
+        std::vector<unsigned char> enc;
+        ASSERT_EQ(l2encdec::encode(input, enc, params), l2encdec::EncodeResult::SUCCESS);
+
+        for (size_t piece : {size_t(1), size_t(7), size_t(4099), input.size()})
+        {
+            SCOPED_TRACE(testing::Message() << protocol << " in pieces of " << piece);
+
+            std::vector<unsigned char> streamed;
+            l2encdec::Encoder encoder(params, append_to(streamed), input.size());
+            ASSERT_EQ(feed_in_pieces(encoder, input, piece), l2encdec::EncodeResult::SUCCESS);
+            EXPECT_EQ(streamed, enc);
+
+            std::vector<unsigned char> dec;
+            l2encdec::Decoder decoder(params, append_to(dec));
+            ASSERT_EQ(feed_in_pieces(decoder, enc, piece), l2encdec::DecodeResult::SUCCESS);
+            EXPECT_EQ(dec, input);
+            EXPECT_EQ(decoder.verify_checksum(), l2encdec::ChecksumResult::SUCCESS);
+        }
+    }
+}
+
+TEST(L2Stream, RSAWithoutInputSize)
+{
+    auto input = make_input(100000);
+    l2encdec::Params params;
+    ASSERT_TRUE(l2encdec::init_params(params, 413));
+
+    std::vector<unsigned char> enc;
+    ASSERT_EQ(l2encdec::encode(input, enc, params), l2encdec::EncodeResult::SUCCESS);
+
+    std::vector<unsigned char> streamed;
+    l2encdec::Encoder encoder(params, append_to(streamed));
+    ASSERT_EQ(feed_in_pieces(encoder, input, 1000), l2encdec::EncodeResult::SUCCESS);
+    EXPECT_EQ(streamed, enc);
+}
+
+TEST(L2Stream, RSAInputSizeMismatch)
+{
+    auto input = make_input(1000);
+    l2encdec::Params params;
+    ASSERT_TRUE(l2encdec::init_params(params, 413));
+
+    std::vector<unsigned char> ignored;
+    l2encdec::Encoder short_input(params, append_to(ignored), input.size() + 1);
+    EXPECT_EQ(feed_in_pieces(short_input, input, 100), l2encdec::EncodeResult::COMPRESSION_FAILED);
+
+    l2encdec::Encoder long_input(params, append_to(ignored), input.size() - 1);
+    EXPECT_EQ(long_input.feed(std::as_bytes(std::span(input))), l2encdec::EncodeResult::COMPRESSION_FAILED);
+    EXPECT_EQ(long_input.finish(), l2encdec::EncodeResult::COMPRESSION_FAILED);
+}
+
+TEST(L2Stream, CustomHeaderWithoutTail)
+{
+    auto input = make_input(5000);
+    l2encdec::Params params;
+    ASSERT_TRUE(l2encdec::init_params(params, 211));
+    params.header = "Custom";
+    params.skip_tail = true;
+
+    std::vector<unsigned char> enc;
+    ASSERT_EQ(l2encdec::encode(input, enc, params), l2encdec::EncodeResult::SUCCESS);
+
+    std::vector<unsigned char> streamed;
+    l2encdec::Encoder encoder(params, append_to(streamed));
+    ASSERT_EQ(feed_in_pieces(encoder, input, 333), l2encdec::EncodeResult::SUCCESS);
+    EXPECT_EQ(streamed, enc);
+
+    std::vector<unsigned char> dec;
+    l2encdec::Decoder decoder(params, append_to(dec));
+    ASSERT_EQ(feed_in_pieces(decoder, enc, 5), l2encdec::DecodeResult::SUCCESS);
+    EXPECT_EQ(dec, input);
+}
+
+TEST(L2Stream, ChecksumMismatch)
+{
+    auto input = make_input(1000);
+    std::vector<unsigned char> enc;
+    ASSERT_EQ(l2encdec::encode(input, enc, 111), l2encdec::EncodeResult::SUCCESS);
+    enc[100] ^= 0xFF;
+
+    l2encdec::Params params;
+    ASSERT_TRUE(l2encdec::init_params(params, 111));
+    std::vector<unsigned char> dec;
+    l2encdec::Decoder decoder(params, append_to(dec));
+    ASSERT_EQ(feed_in_pieces(decoder, enc, 64), l2encdec::DecodeResult::SUCCESS);
+    EXPECT_EQ(decoder.verify_checksum(), l2encdec::ChecksumResult::MISMATCH);
+    EXPECT_EQ(l2encdec::verify_checksum(enc), l2encdec::ChecksumResult::MISMATCH);
+}
+
+TEST(L2Stream, RejectsCallsAfterFinish)
+{
+    auto input = make_input(1000);
+
+    for (int protocol : {111, 211, 413})
+    {
+        SCOPED_TRACE(protocol);
+        l2encdec::Params params;
+        ASSERT_TRUE(l2encdec::init_params(params, protocol));
+
+        std::vector<unsigned char> enc;
+        l2encdec::Encoder encoder(params, append_to(enc));
+        ASSERT_EQ(feed_in_pieces(encoder, input, 100), l2encdec::EncodeResult::SUCCESS);
+        auto encoded = enc;
+        EXPECT_EQ(encoder.finish(), l2encdec::EncodeResult::ALREADY_FINISHED);
+        EXPECT_EQ(encoder.feed(std::as_bytes(std::span(input))), l2encdec::EncodeResult::ALREADY_FINISHED);
+        EXPECT_EQ(enc, encoded);
+
+        std::vector<unsigned char> dec;
+        l2encdec::Decoder decoder(params, append_to(dec));
+        ASSERT_EQ(feed_in_pieces(decoder, enc, 100), l2encdec::DecodeResult::SUCCESS);
+        EXPECT_EQ(decoder.finish(), l2encdec::DecodeResult::ALREADY_FINISHED);
+        EXPECT_EQ(decoder.feed(std::as_bytes(std::span(enc))), l2encdec::DecodeResult::ALREADY_FINISHED);
+        EXPECT_EQ(dec, input);
+        EXPECT_EQ(decoder.verify_checksum(), l2encdec::ChecksumResult::SUCCESS);
+    }
+}
+
+TEST(L2Stream, RejectsTruncatedInput)
+{
+    l2encdec::Params params;
+    ASSERT_TRUE(l2encdec::init_params(params, 413));
+
+    std::vector<unsigned char> dec;
+    l2encdec::Decoder too_short(params, append_to(dec));
+    std::vector<unsigned char> header(10);
+    ASSERT_EQ(too_short.feed(std::as_bytes(std::span(header))), l2encdec::DecodeResult::SUCCESS);
+    EXPECT_EQ(too_short.finish(), l2encdec::DecodeResult::INVALID_TYPE);
+    EXPECT_EQ(too_short.feed(std::as_bytes(std::span(header))), l2encdec::DecodeResult::INVALID_TYPE);
+
+    auto input = make_input(1000);
+    std::vector<unsigned char> enc;
+    ASSERT_EQ(l2encdec::encode(input, enc, params), l2encdec::EncodeResult::SUCCESS);
+    // drops the last payload byte, leaving a partial block in front of the tail
+    enc.erase(enc.end() - 21);
+
+    l2encdec::Decoder partial_block(params, append_to(dec));
+    EXPECT_EQ(feed_in_pieces(partial_block, enc, 50), l2encdec::DecodeResult::DECRYPTION_FAILED);
+}
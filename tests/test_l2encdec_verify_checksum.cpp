@@ -42,3 +42,17 @@ TEST(L2Checksum, VerifyMismatch)
         l2encdec::verify_checksum(data),
         l2encdec::ChecksumResult::MISMATCH);
 }
+
+TEST(L2Checksum, VerifySpan)
+{
+    std::vector<unsigned char> data = {'A', 'B', 'C'};
+    utils::add_tail(data, utils::make_tail(zlib_utils::checksum(data), CRC32_OFFSET, TAIL_SIZE));
+
+    EXPECT_EQ(
+        l2encdec::verify_checksum(std::as_bytes(std::span(data))),
+        l2encdec::ChecksumResult::SUCCESS);
+
+    EXPECT_EQ(
+        l2encdec::verify_checksum(std::as_bytes(std::span(data).first(TAIL_SIZE - 1))),
+        l2encdec::ChecksumResult::MISMATCH);
+}
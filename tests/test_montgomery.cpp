@@ -0,0 +1,65 @@
+#include "montgomery.h"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+static std::vector<unsigned char> from_hex(const std::string &hex)
+{
+    std::vector<unsigned char> bytes;
+    for (size_t i = 0; i < hex.size(); i += 2)
+        bytes.push_back(static_cast<unsigned char>(std::stoi(hex.substr(i, 2), nullptr, 16)));
+    return bytes;
+}
+
+static const std::string MODULUS_411 = "8c9d5da87b30f5d7cd9dc88c746eaac5bb180267fa11737358c4c95d9adf59dd37689f9befb251508759555d6fe0eca87bebe0a10712cf0ec245af84cd22eb4cb675e98eaf5799fca62a20a2baa4801d5d70718dcd43283b8428f1387aec6600f937bfc7bb72404d187d3a9c438f1ffce9ce365dccf754232ff6def038a41385";
+static const std::string MODULUS_MODERN = "75b4d6de5c016544068a1acf125869f43d2e09fc55b8b1e289556daf9b8757635593446288b3653da1ce91c87bb1a5c18f16323495c55d7d72c0890a83f69bfd1fd9434eb1c02f3e4679edfa43309319070129c267c85604d87bb65bae205de3707af1d2108881abb567c3b3d069ae67c3a4c6a3aa93d26413d4c66094ae2039";
+
+static std::vector<unsigned char> make_block()
+{
+    std::vector<unsigned char> block(montgomery::BYTES);
+    for (size_t i = 0; i < block.size(); ++i)
+        block[i] = static_cast<unsigned char>(i * 37 + 11);
+    return block;
+}
+
+TEST(Montgomery, MatchesReferenceExpMod)
+{
+    montgomery::Context ctx;
+    ASSERT_TRUE(montgomery::init(ctx, from_hex(MODULUS_411).data(), 0x1d));
+
+    auto block = make_block();
+    std::vector<unsigned char> out(montgomery::BYTES);
+    montgomery::exp_mod(ctx, block.data(), out.data());
+
+    EXPECT_EQ(out, from_hex("23af55f40e50f7fad226e1b71b3578cd38174036c03d8ce87e574592c3fbc03d1302822b001a9d4a900d0da09806d72a98647124ef618923ab1a8ca2f9c7b141f0790e6496cbb2b626c7886fac3682007e398e13cb3dac64a2204c3b630fc00401fa689a11c004ad9c1c848da62b88b4428dcb166f141511bedacfa468d220fd"));
+
+    ASSERT_TRUE(montgomery::init(ctx, from_hex(MODULUS_411).data(), 0x35));
+    montgomery::exp_mod(ctx, block.data(), block.data());
+    EXPECT_EQ(block, from_hex("83b710b1f9e2ce30e3652e06d0063c8e57c44da8e030206c735e3cdb4dadd6a54bac7d6ec8fefd69d4d847f0a1393dc899b8d8eaffac8018c9b1f3a844c6dd91a5a96a6fb79157415ee279289eb033e06c47b80eab62dfd93abadc94498f0389c0c172d59866330725416c36f186f6af126b7256f6007a31b0a696c4e16bf694"));
+}
+
+TEST(Montgomery, ReducesInputAboveModulus)
+{
+    montgomery::Context ctx;
+    ASSERT_TRUE(montgomery::init(ctx, from_hex(MODULUS_MODERN).data(), 0x1d));
+
+    std::vector<unsigned char> block(montgomery::BYTES, 0xFF);
+    montgomery::exp_mod(ctx, block.data(), block.data());
+
+    EXPECT_EQ(block, from_hex("3f8cb87245250195fe689e84a57b7646a1237f867c7df4d516bd6179f5b2349aca15c26da79d956a5f76237e0b4beca739be296a08129dd94b9f57170988c0cb8fba4147201a1571ab419b90d090f67631a949664daecc9d3318aa315e322cb5da1b63b63d9c7e4053e936aeccf49b2f5a39acdcc17fa5483823fb597ab5ff9d"));
+}
+
+TEST(Montgomery, RejectsUnsupportedParameters)
+{
+    montgomery::Context ctx;
+    auto modulus = from_hex(MODULUS_411);
+    EXPECT_FALSE(montgomery::init(ctx, modulus.data(), 0));
+
+    modulus.back() &= 0xFE;
+    EXPECT_FALSE(montgomery::init(ctx, modulus.data(), 0x1d));
+
+    std::vector<unsigned char> short_modulus(montgomery::BYTES, 0);
+    short_modulus[montgomery::BYTES / 2] = 0x01;
+    short_modulus.back() = 0x01;
+    EXPECT_FALSE(montgomery::init(ctx, short_modulus.data(), 0x1d));
+}
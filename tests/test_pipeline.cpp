@@ -0,0 +1,110 @@
+#include "pipeline.h"
+#include "rsa.h"
+#include "thread_pool.h"
+#include "zlib_utils.h"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+const std::string MODULUS = "75b4d6de5c016544068a1acf125869f43d2e09fc55b8b1e289556daf9b8757635593446288b3653da1ce91c87bb1a5c18f16323495c55d7d72c0890a83f69bfd1fd9434eb1c02f3e4679edfa43309319070129c267c85604d87bb65bae205de3707af1d2108881abb567c3b3d069ae67c3a4c6a3aa93d26413d4c66094ae2039";
+const std::string PUBLIC_EXPONENT = "30b4c2d798d47086145c75063c8e841e719776e400291d7838d3e6c4405b504c6a07f8fca27f32b86643d2649d1d5f124cdd0bf272f0909dd7352fe10a77b34d831043d9ae541f8263c6fe3d1c14c2f04e43a7253a6dda9a8c1562cbd493c1b631a1957618ad5dfe5ca28553f746e2fc6f2db816c7db223ec91e955081c1de65";
+const std::string PRIVATE_EXPONENT = "1d";
+
+// compresses to a few dozen handoffs, so both stages overlap
+std::vector<unsigned char> make_input(size_t size)
+{
+    std::vector<unsigned char> input;
+    input.reserve(size);
+    uint32_t state = 7;
+    while (input.size() < size)
+    {
+        state = state * 1103515245 + 12345;
+        std::string line = "item_" + std::to_string(state >> 24) + "=" + std::to_string((state >> 8) % 100) + "\n";
+        input.insert(input.end(), line.begin(), line.end());
+    }
+    input.resize(size);
+    return input;
+}
+
+std::vector<unsigned char> sequential_encode(const std::vector<unsigned char> &input, const rsa::Key &key)
+{
+    std::vector<unsigned char> packed, encrypted;
+    zlib_utils::pack(input, packed);
+    rsa::encrypt(packed, encrypted, key);
+    return encrypted;
+}
+
+std::vector<unsigned char> as_vector(const memory::Scratch &scratch)
+{
+    return {scratch.data(), scratch.data() + scratch.size()};
+}
+} // namespace
+
+TEST(Pipeline, EncodeMatchesSequential)
+{
+    // the small exponent keeps this fast; the block layout does not depend on the key
+    auto key = rsa::load_key(MODULUS, PRIVATE_EXPONENT);
+    ASSERT_NE(key, nullptr);
+
+    for (size_t size : {0, 1, 119, 120, 4096, 300 * 1024})
+    {
+        auto input = make_input(size);
+        memory::Scratch blocks(nullptr);
+        ASSERT_EQ(pipeline::encode(input, zlib_utils::BEST_COMPRESSION, *key, blocks), l2encdec::EncodeResult::SUCCESS) << size;
+        EXPECT_EQ(as_vector(blocks), sequential_encode(input, *key)) << size;
+    }
+}
+
+TEST(Pipeline, SingleThreadMatchesSequential)
+{
+    auto key = rsa::load_key(MODULUS, PRIVATE_EXPONENT);
+    ASSERT_NE(key, nullptr);
+    auto input = make_input(300 * 1024);
+
+    thread_pool::set_max_threads(1);
+    memory::Scratch blocks(nullptr);
+    auto result = pipeline::encode(input, zlib_utils::BEST_COMPRESSION, *key, blocks);
+    thread_pool::set_max_threads(0);
+
+    ASSERT_EQ(result, l2encdec::EncodeResult::SUCCESS);
+    EXPECT_EQ(as_vector(blocks), sequential_encode(input, *key));
+}
+
+TEST(Pipeline, DecodeRoundTrip)
+{
+    auto public_key = rsa::load_key(MODULUS, PUBLIC_EXPONENT);
+    auto private_key = rsa::load_key(MODULUS, PRIVATE_EXPONENT);
+    ASSERT_NE(public_key, nullptr);
+    ASSERT_NE(private_key, nullptr);
+
+    auto input = make_input(300 * 1024);
+    auto blocks = sequential_encode(input, *public_key);
+
+    std::vector<unsigned char> output(input.size());
+    ASSERT_EQ(pipeline::decode(blocks, *private_key, output), l2encdec::DecodeResult::SUCCESS);
+    EXPECT_EQ(output, input);
+
+    thread_pool::set_max_threads(1);
+    std::fill(output.begin(), output.end(), 0);
+    auto result = pipeline::decode(blocks, *private_key, output);
+    thread_pool::set_max_threads(0);
+    ASSERT_EQ(result, l2encdec::DecodeResult::SUCCESS);
+    EXPECT_EQ(output, input);
+}
+
+TEST(Pipeline, DecodeRejectsCorruptBlock)
+{
+    auto public_key = rsa::load_key(MODULUS, PUBLIC_EXPONENT);
+    auto private_key = rsa::load_key(MODULUS, PRIVATE_EXPONENT);
+    auto input = make_input(300 * 1024);
+    auto blocks = sequential_encode(input, *public_key);
+
+    blocks[blocks.size() / 2] ^= 0x5A;
+    std::vector<unsigned char> output(input.size());
+    EXPECT_NE(pipeline::decode(blocks, *private_key, output), l2encdec::DecodeResult::SUCCESS);
+
+    blocks.pop_back();
+    EXPECT_EQ(pipeline::decode(blocks, *private_key, output), l2encdec::DecodeResult::DECRYPTION_FAILED);
+}
@@ -22,6 +22,24 @@ TEST(RSABasic, AddRemovePaddingRoundTrip)
     EXPECT_EQ(result, plain);
 }
 
+TEST(RSABasic, SealBlockMatchesPadding)
+{
+    for (size_t size = 1; size <= rsa::BLOCK_BODY_SIZE; ++size)
+    {
+        std::vector<uint8_t> input(size);
+        for (size_t i = 0; i < size; ++i)
+            input[i] = static_cast<uint8_t>(i + 1);
+        std::vector<uint8_t> padded;
+        rsa::add_padding(padded, input);
+
+        std::vector<uint8_t> block(rsa::BLOCK_SIZE, 0xEE);
+        std::copy(input.begin(), input.end(), block.begin() + rsa::BLOCK_SIZE - rsa::BLOCK_BODY_SIZE);
+        rsa::seal_block(block.data(), size);
+        EXPECT_EQ(block, padded) << size;
+        EXPECT_EQ(rsa::remove_padding(std::span(block)), size);
+    }
+}
+
 TEST(RSAEncryptDecrypt, EncryptDecryptRoundTrip)
 {
     const l2encdec::Params params = {
@@ -35,3 +53,65 @@ TEST(RSAEncryptDecrypt, EncryptDecryptRoundTrip)
     rsa::decrypt(enc, dec, params.rsa_modulus, params.rsa_private_exponent);
     EXPECT_EQ(dec, input);
 }
+
+TEST(RSAEncryptDecrypt, MultiBlockRoundTrip)
+{
+    const std::string modulus = "75b4d6de5c016544068a1acf125869f43d2e09fc55b8b1e289556daf9b8757635593446288b3653da1ce91c87bb1a5c18f16323495c55d7d72c0890a83f69bfd1fd9434eb1c02f3e4679edfa43309319070129c267c85604d87bb65bae205de3707af1d2108881abb567c3b3d069ae67c3a4c6a3aa93d26413d4c66094ae2039";
+    const std::string public_exponent = "30b4c2d798d47086145c75063c8e841e719776e400291d7838d3e6c4405b504c6a07f8fca27f32b86643d2649d1d5f124cdd0bf272f0909dd7352fe10a77b34d831043d9ae541f8263c6fe3d1c14c2f04e43a7253a6dda9a8c1562cbd493c1b631a1957618ad5dfe5ca28553f746e2fc6f2db816c7db223ec91e955081c1de65";
+    std::vector<unsigned char> input(124 * 40 + 17);
+    for (size_t i = 0; i < input.size(); ++i)
+        input[i] = static_cast<unsigned char>(i * 31 + 7);
+
+    std::vector<unsigned char> enc, dec;
+    ASSERT_EQ(rsa::encrypt(input, enc, modulus, public_exponent), 0);
+    ASSERT_EQ(enc.size(), 41u * 128u);
+    ASSERT_EQ(rsa::decrypt(enc, dec, modulus, "1d"), 0);
+    EXPECT_EQ(dec, input);
+}
+
+TEST(RSAEncryptDecrypt, EncryptBatchRoundTrip)
+{
+    const std::string modulus = "75b4d6de5c016544068a1acf125869f43d2e09fc55b8b1e289556daf9b8757635593446288b3653da1ce91c87bb1a5c18f16323495c55d7d72c0890a83f69bfd1fd9434eb1c02f3e4679edfa43309319070129c267c85604d87bb65bae205de3707af1d2108881abb567c3b3d069ae67c3a4c6a3aa93d26413d4c66094ae2039";
+    const std::string public_exponent = "30b4c2d798d47086145c75063c8e841e719776e400291d7838d3e6c4405b504c6a07f8fca27f32b86643d2649d1d5f124cdd0bf272f0909dd7352fe10a77b34d831043d9ae541f8263c6fe3d1c14c2f04e43a7253a6dda9a8c1562cbd493c1b631a1957618ad5dfe5ca28553f746e2fc6f2db816c7db223ec91e955081c1de65";
+    auto key = rsa::load_key(modulus, public_exponent);
+    ASSERT_NE(key, nullptr);
+
+    std::vector<std::vector<unsigned char>> inputs;
+    for (size_t size : {1, 124, 125, 124 * 9 + 3})
+    {
+        std::vector<unsigned char> input(size);
+        for (size_t i = 0; i < size; ++i)
+            input[i] = static_cast<unsigned char>(i * 13 + size);
+        inputs.push_back(std::move(input));
+    }
+
+    std::vector<std::vector<unsigned char>> outputs;
+    ASSERT_EQ(rsa::encrypt_batch(inputs, outputs, *key), 0);
+    ASSERT_EQ(outputs.size(), inputs.size());
+
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        std::vector<unsigned char> single, dec;
+        ASSERT_EQ(rsa::encrypt(inputs[i], single, *key), 0);
+        EXPECT_EQ(outputs[i], single);
+        ASSERT_EQ(rsa::decrypt(outputs[i], dec, modulus, "1d"), 0);
+        EXPECT_EQ(dec, inputs[i]);
+    }
+}
+
+TEST(RSAKey, LoadKeyIsCached)
+{
+    const std::string modulus = "8c9d5da87b30f5d7cd9dc88c746eaac5bb180267fa11737358c4c95d9adf59dd37689f9befb251508759555d6fe0eca87bebe0a10712cf0ec245af84cd22eb4cb675e98eaf5799fca62a20a2baa4801d5d70718dcd43283b8428f1387aec6600f937bfc7bb72404d187d3a9c438f1ffce9ce365dccf754232ff6def038a41385";
+
+    auto first = rsa::load_key(modulus, "1d");
+    auto second = rsa::load_key(modulus, "1d");
+    ASSERT_NE(first, nullptr);
+    EXPECT_EQ(first, second);
+    EXPECT_NE(rsa::load_key(modulus, "25"), first);
+}
+
+TEST(RSAKey, LoadKeyRejectsInvalidHex)
+{
+    EXPECT_EQ(rsa::load_key("xyz", "1d"), nullptr);
+    EXPECT_EQ(rsa::load_key("10", "1d"), nullptr);
+}
@@ -0,0 +1,74 @@
+#include "thread_pool.h"
+#include <atomic>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+TEST(ThreadPool, CoversEveryIndexOnce)
+{
+    std::vector<std::atomic<int>> hits(1000);
+
+    thread_pool::parallel_for(hits.size(), 7, [&](size_t begin, size_t end)
+                              {
+        for (size_t i = begin; i < end; ++i)
+            hits[i].fetch_add(1); });
+
+    for (auto &hit : hits)
+        EXPECT_EQ(hit.load(), 1);
+}
+
+TEST(ThreadPool, SingleRangeRunsInline)
+{
+    auto caller = std::this_thread::get_id();
+    std::thread::id runner;
+
+    thread_pool::parallel_for(16, 16, [&](size_t begin, size_t end)
+                              {
+        EXPECT_EQ(begin, 0u);
+        EXPECT_EQ(end, 16u);
+        runner = std::this_thread::get_id(); });
+
+    EXPECT_EQ(runner, caller);
+}
+
+TEST(ThreadPool, ConcurrentCallers)
+{
+    std::atomic<size_t> total(0);
+    std::vector<std::thread> callers;
+
+    for (int t = 0; t < 4; ++t)
+        callers.emplace_back([&]()
+                             {
+            for (int round = 0; round < 50; ++round)
+                thread_pool::parallel_for(64, 1, [&](size_t begin, size_t end)
+                                          { total.fetch_add(end - begin); }); });
+
+    for (auto &caller : callers)
+        caller.join();
+
+    EXPECT_EQ(total.load(), 4u * 50u * 64u);
+}
+
+TEST(ThreadPool, MaxThreadsLimitsParticipants)
+{
+    for (size_t limit : {1, 2})
+    {
+        thread_pool::set_max_threads(limit);
+        EXPECT_LE(thread_pool::concurrency(), limit);
+
+        std::mutex mutex;
+        std::set<std::thread::id> runners;
+        thread_pool::parallel_for(64, 1, [&](size_t, size_t)
+                                  {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            std::lock_guard<std::mutex> lock(mutex);
+            runners.insert(std::this_thread::get_id()); });
+
+        EXPECT_LE(runners.size(), limit);
+    }
+
+    thread_pool::set_max_threads(0);
+}
@@ -1,5 +1,6 @@
 #include "xor_utils.h"
 #include <gtest/gtest.h>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -43,3 +44,45 @@ TEST(XOREncryptDecrypt, SymmetricKeyGenerator)
     xor_utils::apply(enc, dec, start_index, kg);
     EXPECT_EQ(dec, input);
 }
+
+TEST(XOREncryptDecrypt, SingleKeyMatchesScalarAtEverySize)
+{
+    std::vector<unsigned char> input(200);
+    for (size_t i = 0; i < input.size(); ++i)
+        input[i] = static_cast<unsigned char>(i * 37);
+
+    for (size_t size = 0; size <= input.size(); ++size)
+    {
+        std::vector<unsigned char> output(size);
+        xor_utils::apply(std::span(input).first(size), std::span(output), 0xAC);
+        for (size_t i = 0; i < size; ++i)
+            ASSERT_EQ(output[i], input[i] ^ 0xAC) << "size " << size << " at " << i;
+    }
+}
+
+TEST(XOREncryptDecrypt, PositionMatchesKeyByIndex)
+{
+    std::vector<unsigned char> input(3 * 0x10000 + 123);
+    for (size_t i = 0; i < input.size(); ++i)
+        input[i] = static_cast<unsigned char>(i * 13 + 1);
+
+    for (int start_index : {0, 0xE6, 0xFFF1, 0x12345})
+    {
+        std::vector<unsigned char> output(input.size() - 3);
+        xor_utils::apply_position(std::span(input).subspan(3), std::span(output), start_index);
+
+        for (size_t i = 0; i < output.size(); ++i)
+            ASSERT_EQ(output[i], input[i + 3] ^ xor_utils::get_key_by_index(start_index + static_cast<int>(i)))
+                << "start " << start_index << " at " << i;
+    }
+}
+
+TEST(XOREncryptDecrypt, KeyByIndexGeneratorUsesKeystream)
+{
+    std::vector<unsigned char> input(1000, 0x5A);
+    std::vector<unsigned char> expected(input.size()), output;
+
+    xor_utils::apply_position(input, expected, 0xE6);
+    xor_utils::apply(input, output, 0xE6, xor_utils::get_key_by_index);
+    EXPECT_EQ(output, expected);
+}
@@ -1,4 +1,8 @@
+#include "thread_pool.h"
 #include "zlib_utils.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <gtest/gtest.h>
 #include <string>
 #include <vector>
@@ -18,3 +22,225 @@ TEST(ZlibUtils, PackUnpackRoundTrip)
     std::string out(unpacked.begin(), unpacked.end());
     EXPECT_EQ(out, s);
 }
+
+TEST(ZlibUtils, PackAtEveryLevel)
+{
+    std::string s = "[Settings]\nWidth=1024\nHeight=768\nFullscreen=False\n";
+    std::vector<unsigned char> input;
+    for (int i = 0; i < 100; ++i)
+        input.insert(input.end(), s.begin(), s.end());
+
+    for (int level = 0; level <= zlib_utils::BEST_COMPRESSION; ++level)
+    {
+        std::vector<unsigned char> packed, unpacked;
+        ASSERT_EQ(zlib_utils::pack(input, packed, level), 0) << "level " << level;
+        ASSERT_EQ(zlib_utils::unpack(packed, unpacked), 0) << "level " << level;
+        EXPECT_EQ(unpacked, input) << "level " << level;
+    }
+
+    std::vector<unsigned char> packed;
+    EXPECT_NE(zlib_utils::pack(input, packed, -1), 0);
+    EXPECT_NE(zlib_utils::pack(input, packed, zlib_utils::BEST_COMPRESSION + 1), 0);
+}
+
+TEST(ZlibUtils, UnpackIntoExactSpan)
+{
+    std::vector<unsigned char> input(5000, 'z');
+    std::vector<unsigned char> packed;
+    ASSERT_EQ(zlib_utils::pack(input, packed), 0);
+
+    size_t size = 0;
+    ASSERT_EQ(zlib_utils::unpacked_size(packed, size), 0);
+    ASSERT_EQ(size, input.size());
+
+    std::vector<unsigned char> output(size);
+    ASSERT_EQ(zlib_utils::unpack(std::span(packed), std::span(output)), 0);
+    EXPECT_EQ(output, input);
+
+    output.resize(size - 1);
+    EXPECT_NE(zlib_utils::unpack(std::span(packed), std::span(output)), 0);
+}
+
+TEST(ZlibUtils, RejectsImplausibleSizeHeader)
+{
+    std::vector<unsigned char> input(100, 'a');
+    std::vector<unsigned char> packed, unpacked;
+    ASSERT_EQ(zlib_utils::pack(input, packed), 0);
+
+    uint32_t hostile_size = 0xFFFFFFF0;
+    std::memcpy(packed.data(), &hostile_size, sizeof(hostile_size));
+
+    size_t size = 0;
+    EXPECT_NE(zlib_utils::unpacked_size(packed, size), 0);
+    EXPECT_NE(zlib_utils::unpack(packed, unpacked), 0);
+    EXPECT_TRUE(unpacked.empty());
+}
+
+TEST(ZlibUtils, HighlyCompressibleInputUnpacks)
+{
+    std::vector<unsigned char> input(8 * 1024 * 1024, 0);
+    std::vector<unsigned char> packed, unpacked;
+    ASSERT_EQ(zlib_utils::pack(input, packed), 0);
+
+    ASSERT_EQ(zlib_utils::unpack(packed, unpacked), 0);
+    EXPECT_EQ(unpacked, input);
+}
+
+TEST(ZlibUtils, SinkAndSourceInSmallPieces)
+{
+    std::vector<unsigned char> input(200000);
+    for (size_t i = 0; i < input.size(); ++i)
+        input[i] = static_cast<unsigned char>((i * i) >> 7);
+
+    std::vector<unsigned char> packed, streamed;
+    ASSERT_EQ(zlib_utils::pack(input, packed), 0);
+    ASSERT_EQ(zlib_utils::pack(input, [&](std::span<const unsigned char> chunk)
+                               { streamed.insert(streamed.end(), chunk.begin(), chunk.end()); }),
+              0);
+    EXPECT_EQ(streamed, packed);
+
+    // odd piece sizes split the size prefix and the zlib header
+    size_t pos = 0;
+    std::vector<unsigned char> unpacked(input.size());
+    ASSERT_EQ(zlib_utils::unpack([&]()
+                                 {
+        size_t size = std::min<size_t>(3, packed.size() - pos);
+        auto piece = std::span(packed).subspan(pos, size);
+        pos += size;
+        return std::span<const unsigned char>(piece); },
+                                 unpacked),
+              0);
+    EXPECT_EQ(unpacked, input);
+
+    pos = 0;
+    std::vector<unsigned char> truncated(packed.begin(), packed.end() - 8);
+    ASSERT_NE(zlib_utils::unpack([&]()
+                                 {
+        size_t size = std::min<size_t>(1000, truncated.size() - pos);
+        auto piece = std::span(truncated).subspan(pos, size);
+        pos += size;
+        return std::span<const unsigned char>(piece); },
+                                 unpacked),
+              0);
+}
+
+TEST(ZlibUtils, ChunkedStreamRoundTrip)
+{
+    constexpr size_t CHUNK = zlib_utils::PACK_CHUNK_SIZE;
+    for (size_t size : {size_t(0), size_t(1), CHUNK - 1, CHUNK, CHUNK + 1, 3 * CHUNK + 5})
+    {
+        // repeats across chunk boundaries, so the primed dictionary gets used
+        std::vector<unsigned char> input(size);
+        for (size_t i = 0; i < size; ++i)
+            input[i] = static_cast<unsigned char>((i % 50000) * 7 >> 3);
+
+        for (int level : {0, zlib_utils::BEST_SPEED, zlib_utils::BEST_COMPRESSION})
+        {
+            std::vector<unsigned char> packed, unpacked;
+            ASSERT_EQ(zlib_utils::pack(input, packed, level), 0) << size << " level " << level;
+            ASSERT_EQ(zlib_utils::unpack(packed, unpacked), 0) << size << " level " << level;
+            EXPECT_EQ(unpacked, input) << size << " level " << level;
+        }
+    }
+}
+
+TEST(ZlibUtils, ChunkedStreamIndependentOfThreads)
+{
+    // one incompressible period, repeated
+    constexpr size_t PERIOD = 20000;
+    std::vector<unsigned char> input(5 * zlib_utils::PACK_CHUNK_SIZE / 2);
+    uint32_t state = 1;
+    for (size_t i = 0; i < input.size(); ++i)
+    {
+        state = state * 1103515245 + 12345;
+        input[i] = i < PERIOD ? static_cast<unsigned char>(state >> 16) : input[i - PERIOD];
+    }
+
+    std::vector<unsigned char> parallel, serial;
+    ASSERT_EQ(zlib_utils::pack(input, parallel), 0);
+    thread_pool::set_max_threads(1);
+    int rc = zlib_utils::pack(input, serial);
+    thread_pool::set_max_threads(0);
+    ASSERT_EQ(rc, 0);
+    EXPECT_EQ(parallel, serial);
+    // without priming every chunk would store the period again
+    EXPECT_LT(parallel.size(), PERIOD * 3 / 2);
+}
+
+TEST(ZlibUtils, StreamPackMatchesPack)
+{
+    std::vector<unsigned char> input(zlib_utils::PACK_CHUNK_SIZE * 2 + 12345);
+    for (size_t i = 0; i < input.size(); ++i)
+        input[i] = static_cast<unsigned char>((i * i) >> 9);
+
+    for (size_t size : {input.size(), zlib_utils::PACK_CHUNK_SIZE * 2, size_t(0)})
+    {
+        SCOPED_TRACE(size);
+        auto data = std::span(input).first(size);
+        std::vector<unsigned char> packed;
+        ASSERT_EQ(zlib_utils::pack(data, packed, zlib_utils::BEST_SPEED), 0);
+
+        std::vector<unsigned char> streamed;
+        zlib_utils::StreamPack packer(size, zlib_utils::BEST_SPEED, [&](std::span<const unsigned char> chunk)
+                                      { streamed.insert(streamed.end(), chunk.begin(), chunk.end()); });
+        for (size_t pos = 0; pos < size; pos += 77777)
+            ASSERT_EQ(packer.feed(data.subspan(pos, std::min<size_t>(77777, size - pos))), 0);
+        ASSERT_EQ(packer.finish(), 0);
+        EXPECT_EQ(streamed, packed);
+    }
+
+    zlib_utils::StreamPack short_input(10, zlib_utils::BEST_SPEED, [](std::span<const unsigned char>) {});
+    ASSERT_EQ(short_input.feed(std::span(input).first(9)), 0);
+    EXPECT_NE(short_input.finish(), 0);
+
+    zlib_utils::StreamPack long_input(10, zlib_utils::BEST_SPEED, [](std::span<const unsigned char>) {});
+    EXPECT_NE(long_input.feed(std::span(input).first(11)), 0);
+}
+
+TEST(ZlibUtils, StreamUnpackInPieces)
+{
+    std::vector<unsigned char> input(300000);
+    for (size_t i = 0; i < input.size(); ++i)
+        input[i] = static_cast<unsigned char>((i * i) >> 7);
+
+    std::vector<unsigned char> packed;
+    ASSERT_EQ(zlib_utils::pack(input, packed), 0);
+
+    for (size_t piece : {size_t(1), size_t(3), size_t(70000), packed.size()})
+    {
+        SCOPED_TRACE(piece);
+        std::vector<unsigned char> unpacked;
+        zlib_utils::StreamUnpack unpacker([&](std::span<const unsigned char> chunk)
+                                          { unpacked.insert(unpacked.end(), chunk.begin(), chunk.end()); });
+        for (size_t pos = 0; pos < packed.size(); pos += piece)
+            ASSERT_EQ(unpacker.feed(std::span(packed).subspan(pos, std::min(piece, packed.size() - pos))), 0);
+        ASSERT_EQ(unpacker.finish(), 0);
+        EXPECT_EQ(unpacked, input);
+    }
+
+    zlib_utils::StreamUnpack truncated([](std::span<const unsigned char>) {});
+    ASSERT_EQ(truncated.feed(std::span(packed).first(packed.size() - 8)), 0);
+    EXPECT_NE(truncated.finish(), 0);
+
+    // a prefix promising fewer bytes than the stream holds
+    std::vector<unsigned char> lying = packed;
+    lying[0] ^= 1;
+    zlib_utils::StreamUnpack mismatched([](std::span<const unsigned char>) {});
+    int rc = mismatched.feed(lying);
+    EXPECT_TRUE(rc != 0 || mismatched.finish() != 0);
+}
+
+TEST(ZlibUtils, ChecksumCombine)
+{
+    std::vector<unsigned char> input(100000);
+    for (size_t i = 0; i < input.size(); ++i)
+        input[i] = static_cast<unsigned char>((i * 31) ^ (i >> 5));
+
+    uint32_t whole = zlib_utils::checksum(input);
+    for (size_t split : {size_t(0), size_t(1), size_t(7), size_t(65536), input.size()})
+    {
+        SCOPED_TRACE(split);
+        auto [a, b] = std::pair(std::span(input).first(split), std::span(input).subspan(split));
+        EXPECT_EQ(zlib_utils::checksum_combine(zlib_utils::checksum(a), zlib_utils::checksum(b), b.size()), whole);
+    }
+}